@@ -28,6 +28,14 @@
 //15 minutes WDT for miner task
 #define WDT_MINER_TIMEOUT 900
 
+#if defined(CONFIG_IDF_TARGET_ESP32)
+#define MINER_HW_STACK 3584 // Reduced for ESP32 classic
+#define MINER_SW_STACK 5000 // Reduced for ESP32 classic
+#else
+#define MINER_HW_STACK 4096
+#define MINER_SW_STACK 6000
+#endif
+
 #ifdef PIN_BUTTON_1
   OneButton button1(PIN_BUTTON_1);
 #endif
@@ -125,6 +133,10 @@ void setup()
   /******** INIT WIFI ************/
   init_WifiManager();
 
+  /******** BENCHMARK HW AND SW MINERS *****/
+  //Before the other tasks start so they don't skew it, decides hw or sw and the core of each miner
+  miner_plan plan = minerSchedule(SOC_CPU_CORES_NUM);
+
   /******** CREATE TASK TO PRINT SCREEN *****/
   //tft.pushImage(0, 0, MinerWidth, MinerHeight, MinerScreen);
   // Higher prio monitor task
@@ -157,31 +169,20 @@ void setup()
 
   // Start mining tasks
   //BaseType_t res = xTaskCreate(runWorker, name, 35000, (void*)name, 1, NULL);
-  TaskHandle_t minerTask1, minerTask2 = NULL;
+  //Each miner is pinned to the core it was benchmarked on
+  for (uint8_t i = 0; i < plan.miners; ++i)
+  {
+    TaskHandle_t minerTask = NULL;
+    char name[16];
+    sprintf(name, "Miner%s-%u", plan.hw[i] ? "Hw" : "Sw", i);
   #ifdef HARDWARE_SHA265
-    #if defined(CONFIG_IDF_TARGET_ESP32)
-    xTaskCreate(minerWorkerHw, "MinerHw-0", 3584, (void*)0, 3, &minerTask1); // Reduced for ESP32 classic
-    //xTaskCreate(minerWorkerSw, "MinerSw-0", 5000, (void*)0, 1, &minerTask1); // Reduced for ESP32 classic
-    #else
-    xTaskCreate(minerWorkerHw, "MinerHw-0", 4096, (void*)0, 3, &minerTask1);
-    #endif
-  #else
-    #if defined(CONFIG_IDF_TARGET_ESP32)
-    xTaskCreate(minerWorkerSw, "MinerSw-0", 5000, (void*)0, 1, &minerTask1); // Reduced for ESP32 classic
-    #else
-    xTaskCreate(minerWorkerSw, "MinerSw-0", 6000, (void*)0, 1, &minerTask1);
-    #endif
+    if (plan.hw[i])
+      xTaskCreatePinnedToCore(minerWorkerHw, name, MINER_HW_STACK, (void*)(uint32_t)i, 3, &minerTask, plan.core[i]);
+    else
   #endif
-  esp_task_wdt_add(minerTask1);
-
-#if (SOC_CPU_CORES_NUM >= 2)
-  #if defined(CONFIG_IDF_TARGET_ESP32)
-  xTaskCreate(minerWorkerSw, "MinerSw-1", 5000, (void*)1, 1, &minerTask2); // Reduced for ESP32 classic
-  #else
-  xTaskCreate(minerWorkerSw, "MinerSw-1", 6000, (void*)1, 1, &minerTask2);
-  #endif
-  esp_task_wdt_add(minerTask2);
-#endif
+      xTaskCreatePinnedToCore(minerWorkerSw, name, MINER_SW_STACK, (void*)(uint32_t)i, 1, &minerTask, plan.core[i]);
+    esp_task_wdt_add(minerTask);
+  }
 
   vTaskPrioritySet(NULL, 4);
 
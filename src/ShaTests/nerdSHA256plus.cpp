@@ -15,10 +15,12 @@
 #define NDEBUG
 #include <stdio.h>
 #include <string.h>
+#ifndef NATIVE_TEST
 #include <Arduino.h>
 
 #include <esp_log.h>
 #include <esp_timer.h>
+#endif
 
 #include "nerdSHA256plus.h"
 #include <math.h>
@@ -88,6 +90,314 @@ DRAM_ATTR static const uint32_t K[64] = {
         h = temp1 + temp2;                                                                                             \
     }
 
+//*********** Template round engine ***********
+
+//Round T, the rotating a..h indexes are compile time constants so A[] stays in registers
+template <int T>
+static inline __attribute__((always_inline)) void nerd_round(uint32_t* A, uint32_t x)
+{
+    uint32_t temp1, temp2;
+    P(A[(0 - T) & 7], A[(1 - T) & 7], A[(2 - T) & 7], A[(3 - T) & 7],
+      A[(4 - T) & 7], A[(5 - T) & 7], A[(6 - T) & 7], A[(7 - T) & 7], x, K[T]);
+}
+
+//Message word T, expanded in place when SCHEDULE is set
+template <int T, bool SCHEDULE>
+struct nerd_word {
+    static inline __attribute__((always_inline)) uint32_t get(uint32_t* W) { return W[T]; }
+};
+
+template <int T>
+struct nerd_word<T, true> {
+    static inline __attribute__((always_inline)) uint32_t get(uint32_t* W) { return R(T); }
+};
+
+//Rounds [T, END), schedule is expanded from round SCHED_FROM
+template <int T, int END, int SCHED_FROM>
+struct nerd_rounds {
+    static inline __attribute__((always_inline)) void run(uint32_t* A, uint32_t* W)
+    {
+        nerd_round<T>(A, nerd_word<T, (T >= SCHED_FROM)>::get(W));
+        nerd_rounds<T + 1, END, SCHED_FROM>::run(A, W);
+    }
+};
+
+template <int END, int SCHED_FROM>
+struct nerd_rounds<END, END, SCHED_FROM> {
+    static inline __attribute__((always_inline)) void run(uint32_t*, uint32_t*) {}
+};
+
+template <int OUT_BE>
+static inline __attribute__((always_inline)) void nerd_put_word(uint8_t* doubleHash, int i, uint32_t value)
+{
+    if (OUT_BE)
+        value = (value << 24) | ((value << 8) & 0x00FF0000) | ((value >> 8) & 0x0000FF00) | (value >> 24);
+    ((uint32_t*)doubleHash)[i] = value;
+}
+
+template <int BAKED, int EARLY_EXIT, int OUT_BE>
+IRAM_ATTR bool nerd_sha256d_engine(const uint32_t* digest, const uint8_t* dataIn, const uint32_t* bake, uint8_t* doubleHash)
+{
+    static_assert(BAKED == 0 || BAKED == 3, "only the nerd_sha256_bake() layout (3 rounds) is supported");
+    static_assert(EARLY_EXIT == 0 || EARLY_EXIT == 60, "the last hash word is known after round 60");
+
+    uint32_t W[64] = { 0, 0, 0, GET_UINT32_BE(dataIn, 12),
+                       0x80000000, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 640 };
+    uint32_t A[8];
+
+    //*********** 1rst SHA ***********
+    if (BAKED == 3)
+    {
+        W[0] = bake[0];
+        W[1] = bake[1];
+        W[2] = bake[2];
+        W[16] = bake[3];
+        W[17] = bake[4];
+        for (int i = 0; i < 8; ++i)
+            A[i] = bake[5 + i];
+
+        uint32_t temp1 = bake[13] + W[3];
+        A[0] += temp1;
+        A[4] = temp1 + bake[14];
+
+        nerd_rounds<4, 64, 18>::run(A, W);
+    }
+    else
+    {
+        W[0] = GET_UINT32_BE(dataIn, 0);
+        W[1] = GET_UINT32_BE(dataIn, 4);
+        W[2] = GET_UINT32_BE(dataIn, 8);
+        for (int i = 0; i < 8; ++i)
+            A[i] = digest[i];
+
+        nerd_rounds<0, 64, 16>::run(A, W);
+    }
+
+    //*********** 2nd SHA ***********
+    for (int i = 0; i < 8; ++i)
+        W[i] = A[i] + digest[i];
+    W[8] = 0x80000000;
+    for (int i = 9; i < 15; ++i)
+        W[i] = 0;
+    W[15] = 256;
+
+    A[0] = 0x6A09E667;
+    A[1] = 0xBB67AE85;
+    A[2] = 0x3C6EF372;
+    A[3] = 0xA54FF53A;
+    A[4] = 0x510E527F;
+    A[5] = 0x9B05688C;
+    A[6] = 0x1F83D9AB;
+    A[7] = 0x5BE0CD19;
+
+    if (EARLY_EXIT)
+    {
+        //Rounds 57 to 60 only add their e half before the reject, the a half is finished after it
+        nerd_rounds<0, 57, 16>::run(A, W);
+
+        uint32_t m1 = A[6] + S3(A[3]) + F1(A[3], A[4], A[5]) + K[57] + R(57);
+        A[2] += m1;
+        uint32_t d57_a1 = A[1];
+        uint32_t z1 = A[5] + S3(A[2]) + F1(A[2], A[3], A[4]) + K[58] + R(58);
+        uint32_t d58_a0 = A[0];
+        A[1] += z1;
+        uint32_t t1 = A[4] + S3(A[1]) + F1(A[1], A[2], A[3]) + K[59] + R(59);
+        A[0] += t1;
+        uint32_t temp1 = A[3] + S3(A[0]) + F1(A[0], A[1], A[2]) + K[60] + R(60);
+        uint32_t a7 = A[7] + temp1;
+        if ((uint32_t)(a7 & 0xFFFF) != 0x32E7)
+            return false;
+
+        A[6] = m1 + S2(A[7]) + F0(A[7], d58_a0, d57_a1);
+        A[5] = z1 + S2(A[6]) + F0(A[6], A[7], d58_a0);
+        A[4] = t1 + S2(A[5]) + F0(A[5], A[6], A[7]);
+        A[7] = a7;
+        A[3] = temp1 + S2(A[4]) + F0(A[4], A[5], A[6]);
+    }
+    else
+        nerd_rounds<0, 61, 16>::run(A, W);
+    nerd_rounds<61, 64, 16>::run(A, W);
+
+    nerd_put_word<OUT_BE>(doubleHash, 0, 0x6A09E667 + A[0]);
+    nerd_put_word<OUT_BE>(doubleHash, 1, 0xBB67AE85 + A[1]);
+    nerd_put_word<OUT_BE>(doubleHash, 2, 0x3C6EF372 + A[2]);
+    nerd_put_word<OUT_BE>(doubleHash, 3, 0xA54FF53A + A[3]);
+    nerd_put_word<OUT_BE>(doubleHash, 4, 0x510E527F + A[4]);
+    nerd_put_word<OUT_BE>(doubleHash, 5, 0x9B05688C + A[5]);
+    nerd_put_word<OUT_BE>(doubleHash, 6, 0x1F83D9AB + A[6]);
+    nerd_put_word<OUT_BE>(doubleHash, 7, 0x5BE0CD19 + A[7]);
+    return true;
+}
+
+//Variants built for every target, the kernels below run on them with NERD_SHA256_ENGINE
+template bool nerd_sha256d_engine<0, 0, 1>(const uint32_t* digest, const uint8_t* dataIn, const uint32_t* bake, uint8_t* doubleHash);
+template bool nerd_sha256d_engine<0, 60, 1>(const uint32_t* digest, const uint8_t* dataIn, const uint32_t* bake, uint8_t* doubleHash);
+template bool nerd_sha256d_engine<3, 0, 0>(const uint32_t* digest, const uint8_t* dataIn, const uint32_t* bake, uint8_t* doubleHash);
+template bool nerd_sha256d_engine<3, 0, 1>(const uint32_t* digest, const uint8_t* dataIn, const uint32_t* bake, uint8_t* doubleHash);
+template bool nerd_sha256d_engine<3, 60, 1>(const uint32_t* digest, const uint8_t* dataIn, const uint32_t* bake, uint8_t* doubleHash);
+
+//*********** sha256d of 64 bytes (merkle nodes) ***********
+
+//K[t] + W[t] of the padding block that follows a 64 byte message, its whole schedule is constant
+DRAM_ATTR static const uint32_t KW_PAD64[64] = {
+    0xC28A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+    0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF374,
+    0x649B69C1, 0xF0FE4786, 0x0FE1EDC6, 0x240CF254, 0x4FE9346F, 0x6CC984BE, 0x61B9411E, 0x16F988FA,
+    0xF2C65152, 0xA88E5A6D, 0xB019FC65, 0xB9D99EC7, 0x9A1231C3, 0xE70EEAA0, 0xFDB1232B, 0xC7353EB0,
+    0x3069BAD5, 0xCB976D5F, 0x5A0F118F, 0xDC1EEEFD, 0x0A35B689, 0xDE0B7A04, 0x58F4CA9D, 0xE15D5B16,
+    0x007F3E86, 0x37088980, 0xA507EA32, 0x6FAB9537, 0x17406110, 0x0D8CD6F1, 0xCDAA3B6D, 0xC0BBBE37,
+    0x83613BDA, 0xDB48A363, 0x0B02E931, 0x6FD15CA7, 0x521AFACA, 0x31338431, 0x6ED41A95, 0x6D437890,
+    0xC39C91F2, 0x9ECCABBD, 0xB5C9A0E6, 0x532FB63C, 0xD2C741C6, 0x07237EA3, 0xA4954B68, 0x4C191D76,
+};
+
+//Rounds [T, END) with K + W read from a table
+template <int T, int END>
+struct nerd_rounds_kw {
+    static inline __attribute__((always_inline)) void run(uint32_t* A, const uint32_t* KW)
+    {
+        uint32_t temp1, temp2;
+        P(A[(0 - T) & 7], A[(1 - T) & 7], A[(2 - T) & 7], A[(3 - T) & 7],
+          A[(4 - T) & 7], A[(5 - T) & 7], A[(6 - T) & 7], A[(7 - T) & 7], KW[T], 0);
+        nerd_rounds_kw<T + 1, END>::run(A, KW);
+    }
+};
+
+template <int END>
+struct nerd_rounds_kw<END, END> {
+    static inline __attribute__((always_inline)) void run(uint32_t*, const uint32_t*) {}
+};
+
+IRAM_ATTR void nerd_sha256d_64(const uint8_t* dataIn, uint8_t* doubleHash)
+{
+    static const uint32_t IV[8] = { 0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+                                    0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19 };
+    uint32_t W[64];
+    uint32_t A[8];
+    uint32_t H[8];
+
+    //*********** 1rst SHA, data block ***********
+    for (int i = 0; i < 16; ++i)
+        W[i] = GET_UINT32_BE(dataIn, 4 * i);
+    for (int i = 0; i < 8; ++i)
+        A[i] = IV[i];
+    nerd_rounds<0, 64, 16>::run(A, W);
+    for (int i = 0; i < 8; ++i)
+        A[i] = H[i] = A[i] + IV[i];
+
+    //*********** 1rst SHA, padding block ***********
+    nerd_rounds_kw<0, 64>::run(A, KW_PAD64);
+
+    //*********** 2nd SHA ***********
+    for (int i = 0; i < 8; ++i)
+    {
+        W[i] = A[i] + H[i];
+        A[i] = IV[i];
+    }
+    W[8] = 0x80000000;
+    for (int i = 9; i < 15; ++i)
+        W[i] = 0;
+    W[15] = 256;
+    nerd_rounds<0, 64, 16>::run(A, W);
+
+    for (int i = 0; i < 8; ++i)
+        nerd_put_word<1>(doubleHash, i, A[i] + IV[i]);
+}
+
+void nerd_sha256d_64_batch(const uint8_t* dataIn, uint8_t* doubleHash, size_t count)
+{
+    for (size_t n = 0; n < count; ++n)
+        nerd_sha256d_64(dataIn + 64 * n, doubleHash + 32 * n);
+}
+
+//*********** Streaming sha256d (coinbase) ***********
+
+//One block on top of digest
+static void nerd_sha256_block(uint32_t* digest, const uint8_t* dataIn)
+{
+    uint32_t W[64];
+    uint32_t A[8];
+
+    for (int i = 0; i < 16; ++i)
+        W[i] = GET_UINT32_BE(dataIn, 4 * i);
+    for (int i = 0; i < 8; ++i)
+        A[i] = digest[i];
+    nerd_rounds<0, 64, 16>::run(A, W);
+    for (int i = 0; i < 8; ++i)
+        digest[i] += A[i];
+}
+
+void nerd_sha256_start(nerdSHA256_stream* ctx)
+{
+    ctx->digest[0] = 0x6A09E667;
+    ctx->digest[1] = 0xBB67AE85;
+    ctx->digest[2] = 0x3C6EF372;
+    ctx->digest[3] = 0xA54FF53A;
+    ctx->digest[4] = 0x510E527F;
+    ctx->digest[5] = 0x9B05688C;
+    ctx->digest[6] = 0x1F83D9AB;
+    ctx->digest[7] = 0x5BE0CD19;
+    ctx->length = 0;
+}
+
+void nerd_sha256_update(nerdSHA256_stream* ctx, const uint8_t* dataIn, size_t len)
+{
+    size_t used = ctx->length & 63;
+    ctx->length += len;
+
+    if (used)
+    {
+        size_t fill = 64 - used;
+        if (len < fill)
+        {
+            memcpy(ctx->buffer + used, dataIn, len);
+            return;
+        }
+        memcpy(ctx->buffer + used, dataIn, fill);
+        nerd_sha256_block(ctx->digest, ctx->buffer);
+        dataIn += fill;
+        len -= fill;
+    }
+    for (; len >= 64; len -= 64, dataIn += 64)
+        nerd_sha256_block(ctx->digest, dataIn);
+    memcpy(ctx->buffer, dataIn, len);
+}
+
+void nerd_sha256d_finish(const nerdSHA256_stream* ctx, uint8_t* doubleHash)
+{
+    uint8_t block[64];
+    uint32_t digest[8];
+    size_t used = ctx->length & 63;
+    uint64_t bits = (uint64_t)ctx->length << 3;
+
+    //*********** 1rst SHA, padding ***********
+    memcpy(digest, ctx->digest, sizeof(digest));
+    memcpy(block, ctx->buffer, used);
+    block[used++] = 0x80;
+    if (used > 56)
+    {
+        memset(block + used, 0, 64 - used);
+        nerd_sha256_block(digest, block);
+        used = 0;
+    }
+    memset(block + used, 0, 56 - used);
+    for (int i = 0; i < 8; ++i)
+        block[56 + i] = (uint8_t)(bits >> (56 - 8 * i));
+    nerd_sha256_block(digest, block);
+
+    //*********** 2nd SHA ***********
+    nerdSHA256_stream second;
+    nerd_sha256_start(&second);
+    for (int i = 0; i < 8; ++i)
+        nerd_put_word<1>(block, i, digest[i]);
+    memset(block + 32, 0, 32);
+    block[32] = 0x80;
+    block[62] = 0x01;
+    nerd_sha256_block(second.digest, block);
+
+    for (int i = 0; i < 8; ++i)
+        nerd_put_word<1>(doubleHash, i, second.digest[i]);
+}
+
 uint32_t rotlFixed(uint32_t x, uint32_t y)
     {
         return (x << y) | (x >> (sizeof(y) * 8 - y));
@@ -207,6 +517,12 @@ IRAM_ATTR void nerd_mids(uint32_t* digest, const uint8_t* dataIn)
 
 IRAM_ATTR bool nerd_sha256d(nerdSHA256_context* midstate, const uint8_t* dataIn, uint8_t* doubleHash)
 {
+#ifdef NERD_SHA256_ENGINE
+    if (nerd_sha256d_engine<0, 60, 1>(midstate->digest, dataIn, NULL, doubleHash))
+        return true;
+    doubleHash[30] = 0xFF;
+    return false;
+#else
     uint32_t temp1, temp2;
     uint8_t temp3, temp4;
     uint32_t* buffer32;
@@ -451,6 +767,7 @@ IRAM_ATTR bool nerd_sha256d(nerdSHA256_context* midstate, const uint8_t* dataIn,
 #endif
 
     return true;
+#endif
 }
 
 
@@ -488,6 +805,9 @@ IRAM_ATTR void nerd_sha256_bake(const uint32_t* digest, const uint8_t* dataIn, u
 
 IRAM_ATTR bool nerd_sha256d_baked(const uint32_t* digest, const uint8_t* dataIn, const uint32_t* bake, uint8_t* doubleHash)
 {
+#ifdef NERD_SHA256_ENGINE
+    return nerd_sha256d_engine<3, 60, 1>(digest, dataIn, bake, doubleHash);
+#else
     uint32_t temp1, temp2;
     //*********** Init 1rst SHA ***********
 
@@ -741,4 +1061,639 @@ IRAM_ATTR bool nerd_sha256d_baked(const uint32_t* digest, const uint8_t* dataIn,
     PUT_UINT32_BE(0x5BE0CD19 + A[7], doubleHash, 28);
 #endif
     return true;
+#endif
+}
+
+//*********** Deep bake ***********
+
+/*  Deep bake layout, NERD_DEEPBAKE_WORDS words:
+    [0..14]  same as nerd_sha256_bake()
+    [15..28] K[t] + W[t] of the first block rounds 4..17, W[t] does not depend on the nonce there
+    [29]     W18 without S0(W3)
+    [30]     W19 without W3
+    [31]     W31 without S1(W29) + W24
+    [32]     W32 without S1(W30) + W25
+    The second block padding (W8..W15) and its schedule terms are the same for every job and get folded
+    by the compiler in nerd_sha256d_deepbaked()
+*/
+IRAM_ATTR void nerd_sha256_deepbake(const uint32_t* digest, const uint8_t* dataIn, uint32_t* deepbake)
+{
+    nerd_sha256_bake(digest, dataIn, deepbake);
+
+    uint32_t* kw = deepbake + 15;
+    kw[0] = K[4] + 0x80000000;
+    kw[1] = K[5];
+    kw[2] = K[6];
+    kw[3] = K[7];
+    kw[4] = K[8];
+    kw[5] = K[9];
+    kw[6] = K[10];
+    kw[7] = K[11];
+    kw[8] = K[12];
+    kw[9] = K[13];
+    kw[10] = K[14];
+    kw[11] = K[15] + 640;
+    kw[12] = K[16] + deepbake[3];
+    kw[13] = K[17] + deepbake[4];
+
+    //W18 = S1(W16) + W11 + S0(W3) + W2
+    deepbake[29] = S1(deepbake[3]) + 0 + deepbake[2];
+    //W19 = S1(W17) + W12 + S0(W4) + W3
+    deepbake[30] = S1(deepbake[4]) + 0 + S0(0x80000000);
+    //W31 = S1(W29) + W24 + S0(W16) + W15
+    deepbake[31] = S0(deepbake[3]) + 640;
+    //W32 = S1(W30) + W25 + S0(W17) + W16
+    deepbake[32] = S0(deepbake[4]) + deepbake[3];
+}
+
+//Same as P() with K + x already summed
+#define PK(a, b, c, d, e, f, g, h, KW)                                                                                 \
+    {                                                                                                                  \
+        temp1 = h + S3(e) + F1(e, f, g) + KW;                                                                          \
+        temp2 = S2(a) + F0(a, b, c);                                                                                   \
+        d += temp1;                                                                                                    \
+        h = temp1 + temp2;                                                                                             \
+    }
+
+IRAM_ATTR bool nerd_sha256d_deepbaked(const uint32_t* digest, const uint8_t* dataIn, const uint32_t* deepbake, uint8_t* doubleHash)
+{
+    uint32_t temp1, temp2;
+    uint32_t W[64];
+    //*********** Init 1rst SHA ***********
+
+    W[3] = GET_UINT32_BE(dataIn, 12);
+    W[16] = deepbake[3];
+    W[17] = deepbake[4];
+
+    const uint32_t* a = deepbake + 5;
+    uint32_t A[8] = { a[0], a[1], a[2], a[3],
+                      a[4], a[5], a[6], a[7] };
+
+    //Round 3
+    temp1 = deepbake[13] + W[3];
+    A[0] += temp1;
+    A[4] = temp1 + deepbake[14];
+
+    //Rounds 4..17 W is fixed
+    const uint32_t* kw = deepbake + 15;
+    PK(A[4], A[5], A[6], A[7], A[0], A[1], A[2], A[3], kw[0]);
+    PK(A[3], A[4], A[5], A[6], A[7], A[0], A[1], A[2], kw[1]);
+    PK(A[2], A[3], A[4], A[5], A[6], A[7], A[0], A[1], kw[2]);
+    PK(A[1], A[2], A[3], A[4], A[5], A[6], A[7], A[0], kw[3]);
+    PK(A[0], A[1], A[2], A[3], A[4], A[5], A[6], A[7], kw[4]);
+    PK(A[7], A[0], A[1], A[2], A[3], A[4], A[5], A[6], kw[5]);
+    PK(A[6], A[7], A[0], A[1], A[2], A[3], A[4], A[5], kw[6]);
+    PK(A[5], A[6], A[7], A[0], A[1], A[2], A[3], A[4], kw[7]);
+    PK(A[4], A[5], A[6], A[7], A[0], A[1], A[2], A[3], kw[8]);
+    PK(A[3], A[4], A[5], A[6], A[7], A[0], A[1], A[2], kw[9]);
+    PK(A[2], A[3], A[4], A[5], A[6], A[7], A[0], A[1], kw[10]);
+    PK(A[1], A[2], A[3], A[4], A[5], A[6], A[7], A[0], kw[11]);
+    PK(A[0], A[1], A[2], A[3], A[4], A[5], A[6], A[7], kw[12]);
+    PK(A[7], A[0], A[1], A[2], A[3], A[4], A[5], A[6], kw[13]);
+
+    //Schedule terms that only partly depend on the nonce
+    W[18] = deepbake[29] + S0(W[3]);
+    W[19] = deepbake[30] + W[3];
+    W[20] = S1(W[18]) + 0x80000000;
+    W[21] = S1(W[19]);
+    W[22] = S1(W[20]) + 640;
+    W[23] = S1(W[21]) + W[16];
+    W[24] = S1(W[22]) + W[17];
+    W[25] = S1(W[23]) + W[18];
+    W[26] = S1(W[24]) + W[19];
+    W[27] = S1(W[25]) + W[20];
+    W[28] = S1(W[26]) + W[21];
+    W[29] = S1(W[27]) + W[22];
+    W[30] = S1(W[28]) + W[23] + S0(640U);
+    W[31] = S1(W[29]) + W[24] + deepbake[31];
+    W[32] = S1(W[30]) + W[25] + deepbake[32];
+
+    P(A[6], A[7], A[0], A[1], A[2], A[3], A[4], A[5], W[18], K[18]);
+    P(A[5], A[6], A[7], A[0], A[1], A[2], A[3], A[4], W[19], K[19]);
+    P(A[4], A[5], A[6], A[7], A[0], A[1], A[2], A[3], W[20], K[20]);
+    P(A[3], A[4], A[5], A[6], A[7], A[0], A[1], A[2], W[21], K[21]);
+    P(A[2], A[3], A[4], A[5], A[6], A[7], A[0], A[1], W[22], K[22]);
+    P(A[1], A[2], A[3], A[4], A[5], A[6], A[7], A[0], W[23], K[23]);
+    P(A[0], A[1], A[2], A[3], A[4], A[5], A[6], A[7], W[24], K[24]);
+    P(A[7], A[0], A[1], A[2], A[3], A[4], A[5], A[6], W[25], K[25]);
+    P(A[6], A[7], A[0], A[1], A[2], A[3], A[4], A[5], W[26], K[26]);
+    P(A[5], A[6], A[7], A[0], A[1], A[2], A[3], A[4], W[27], K[27]);
+    P(A[4], A[5], A[6], A[7], A[0], A[1], A[2], A[3], W[28], K[28]);
+    P(A[3], A[4], A[5], A[6], A[7], A[0], A[1], A[2], W[29], K[29]);
+    P(A[2], A[3], A[4], A[5], A[6], A[7], A[0], A[1], W[30], K[30]);
+    P(A[1], A[2], A[3], A[4], A[5], A[6], A[7], A[0], W[31], K[31]);
+    P(A[0], A[1], A[2], A[3], A[4], A[5], A[6], A[7], W[32], K[32]);
+    P(A[7], A[0], A[1], A[2], A[3], A[4], A[5], A[6], R(33), K[33]);
+    P(A[6], A[7], A[0], A[1], A[2], A[3], A[4], A[5], R(34), K[34]);
+    P(A[5], A[6], A[7], A[0], A[1], A[2], A[3], A[4], R(35), K[35]);
+    P(A[4], A[5], A[6], A[7], A[0], A[1], A[2], A[3], R(36), K[36]);
+    P(A[3], A[4], A[5], A[6], A[7], A[0], A[1], A[2], R(37), K[37]);
+    P(A[2], A[3], A[4], A[5], A[6], A[7], A[0], A[1], R(38), K[38]);
+    P(A[1], A[2], A[3], A[4], A[5], A[6], A[7], A[0], R(39), K[39]);
+    P(A[0], A[1], A[2], A[3], A[4], A[5], A[6], A[7], R(40), K[40]);
+    P(A[7], A[0], A[1], A[2], A[3], A[4], A[5], A[6], R(41), K[41]);
+    P(A[6], A[7], A[0], A[1], A[2], A[3], A[4], A[5], R(42), K[42]);
+    P(A[5], A[6], A[7], A[0], A[1], A[2], A[3], A[4], R(43), K[43]);
+    P(A[4], A[5], A[6], A[7], A[0], A[1], A[2], A[3], R(44), K[44]);
+    P(A[3], A[4], A[5], A[6], A[7], A[0], A[1], A[2], R(45), K[45]);
+    P(A[2], A[3], A[4], A[5], A[6], A[7], A[0], A[1], R(46), K[46]);
+    P(A[1], A[2], A[3], A[4], A[5], A[6], A[7], A[0], R(47), K[47]);
+    P(A[0], A[1], A[2], A[3], A[4], A[5], A[6], A[7], R(48), K[48]);
+    P(A[7], A[0], A[1], A[2], A[3], A[4], A[5], A[6], R(49), K[49]);
+    P(A[6], A[7], A[0], A[1], A[2], A[3], A[4], A[5], R(50), K[50]);
+    P(A[5], A[6], A[7], A[0], A[1], A[2], A[3], A[4], R(51), K[51]);
+    P(A[4], A[5], A[6], A[7], A[0], A[1], A[2], A[3], R(52), K[52]);
+    P(A[3], A[4], A[5], A[6], A[7], A[0], A[1], A[2], R(53), K[53]);
+    P(A[2], A[3], A[4], A[5], A[6], A[7], A[0], A[1], R(54), K[54]);
+    P(A[1], A[2], A[3], A[4], A[5], A[6], A[7], A[0], R(55), K[55]);
+    P(A[0], A[1], A[2], A[3], A[4], A[5], A[6], A[7], R(56), K[56]);
+    P(A[7], A[0], A[1], A[2], A[3], A[4], A[5], A[6], R(57), K[57]);
+    P(A[6], A[7], A[0], A[1], A[2], A[3], A[4], A[5], R(58), K[58]);
+    P(A[5], A[6], A[7], A[0], A[1], A[2], A[3], A[4], R(59), K[59]);
+    P(A[4], A[5], A[6], A[7], A[0], A[1], A[2], A[3], R(60), K[60]);
+    P(A[3], A[4], A[5], A[6], A[7], A[0], A[1], A[2], R(61), K[61]);
+    P(A[2], A[3], A[4], A[5], A[6], A[7], A[0], A[1], R(62), K[62]);
+    P(A[1], A[2], A[3], A[4], A[5], A[6], A[7], A[0], R(63), K[63]);
+
+    /* Calculate the second hash (double SHA-256) */
+
+    W[0] = A[0] + digest[0];
+    W[1] = A[1] + digest[1];
+    W[2] = A[2] + digest[2];
+    W[3] = A[3] + digest[3];
+    W[4] = A[4] + digest[4];
+    W[5] = A[5] + digest[5];
+    W[6] = A[6] + digest[6];
+    W[7] = A[7] + digest[7];
+
+    //Round 0 starts from the IV, everything but W0 folds to constants
+    temp1 = 0x5BE0CD19 + S3(0x510E527FU) + F1(0x510E527FU, 0x9B05688CU, 0x1F83D9ABU) + K[0] + W[0];
+    temp2 = S2(0x6A09E667U) + F0(0x6A09E667U, 0xBB67AE85U, 0x3C6EF372U);
+    A[0] = 0x6A09E667;
+    A[1] = 0xBB67AE85;
+    A[2] = 0x3C6EF372;
+    A[3] = 0xA54FF53A + temp1;
+    A[4] = 0x510E527F;
+    A[5] = 0x9B05688C;
+    A[6] = 0x1F83D9AB;
+    A[7] = temp1 + temp2;
+
+    P(A[7], A[0], A[1], A[2], A[3], A[4], A[5], A[6], W[1], K[1]);
+    P(A[6], A[7], A[0], A[1], A[2], A[3], A[4], A[5], W[2], K[2]);
+    P(A[5], A[6], A[7], A[0], A[1], A[2], A[3], A[4], W[3], K[3]);
+    P(A[4], A[5], A[6], A[7], A[0], A[1], A[2], A[3], W[4], K[4]);
+    P(A[3], A[4], A[5], A[6], A[7], A[0], A[1], A[2], W[5], K[5]);
+    P(A[2], A[3], A[4], A[5], A[6], A[7], A[0], A[1], W[6], K[6]);
+    P(A[1], A[2], A[3], A[4], A[5], A[6], A[7], A[0], W[7], K[7]);
+    //Rounds 8..15 padding
+    PK(A[0], A[1], A[2], A[3], A[4], A[5], A[6], A[7], K[8] + 0x80000000);
+    PK(A[7], A[0], A[1], A[2], A[3], A[4], A[5], A[6], K[9]);
+    PK(A[6], A[7], A[0], A[1], A[2], A[3], A[4], A[5], K[10]);
+    PK(A[5], A[6], A[7], A[0], A[1], A[2], A[3], A[4], K[11]);
+    PK(A[4], A[5], A[6], A[7], A[0], A[1], A[2], A[3], K[12]);
+    PK(A[3], A[4], A[5], A[6], A[7], A[0], A[1], A[2], K[13]);
+    PK(A[2], A[3], A[4], A[5], A[6], A[7], A[0], A[1], K[14]);
+    PK(A[1], A[2], A[3], A[4], A[5], A[6], A[7], A[0], K[15] + 256);
+
+    //Padding words folded in the schedule
+    W[16] = S0(W[1]) + W[0];
+    W[17] = S0(W[2]) + W[1] + S1(256U);
+    W[18] = S1(W[16]) + S0(W[3]) + W[2];
+    W[19] = S1(W[17]) + S0(W[4]) + W[3];
+    W[20] = S1(W[18]) + S0(W[5]) + W[4];
+    W[21] = S1(W[19]) + S0(W[6]) + W[5];
+    W[22] = S1(W[20]) + S0(W[7]) + W[6] + 256;
+    W[23] = S1(W[21]) + W[16] + W[7] + S0(0x80000000);
+    W[24] = S1(W[22]) + W[17] + 0x80000000;
+    W[25] = S1(W[23]) + W[18];
+    W[26] = S1(W[24]) + W[19];
+    W[27] = S1(W[25]) + W[20];
+    W[28] = S1(W[26]) + W[21];
+    W[29] = S1(W[27]) + W[22];
+    W[30] = S1(W[28]) + W[23] + S0(256U);
+    W[31] = S1(W[29]) + W[24] + S0(W[16]) + 256;
+
+    P(A[0], A[1], A[2], A[3], A[4], A[5], A[6], A[7], W[16], K[16]);
+    P(A[7], A[0], A[1], A[2], A[3], A[4], A[5], A[6], W[17], K[17]);
+    P(A[6], A[7], A[0], A[1], A[2], A[3], A[4], A[5], W[18], K[18]);
+    P(A[5], A[6], A[7], A[0], A[1], A[2], A[3], A[4], W[19], K[19]);
+    P(A[4], A[5], A[6], A[7], A[0], A[1], A[2], A[3], W[20], K[20]);
+    P(A[3], A[4], A[5], A[6], A[7], A[0], A[1], A[2], W[21], K[21]);
+    P(A[2], A[3], A[4], A[5], A[6], A[7], A[0], A[1], W[22], K[22]);
+    P(A[1], A[2], A[3], A[4], A[5], A[6], A[7], A[0], W[23], K[23]);
+    P(A[0], A[1], A[2], A[3], A[4], A[5], A[6], A[7], W[24], K[24]);
+    P(A[7], A[0], A[1], A[2], A[3], A[4], A[5], A[6], W[25], K[25]);
+    P(A[6], A[7], A[0], A[1], A[2], A[3], A[4], A[5], W[26], K[26]);
+    P(A[5], A[6], A[7], A[0], A[1], A[2], A[3], A[4], W[27], K[27]);
+    P(A[4], A[5], A[6], A[7], A[0], A[1], A[2], A[3], W[28], K[28]);
+    P(A[3], A[4], A[5], A[6], A[7], A[0], A[1], A[2], W[29], K[29]);
+    P(A[2], A[3], A[4], A[5], A[6], A[7], A[0], A[1], W[30], K[30]);
+    P(A[1], A[2], A[3], A[4], A[5], A[6], A[7], A[0], W[31], K[31]);
+    P(A[0], A[1], A[2], A[3], A[4], A[5], A[6], A[7], R(32), K[32]);
+    P(A[7], A[0], A[1], A[2], A[3], A[4], A[5], A[6], R(33), K[33]);
+    P(A[6], A[7], A[0], A[1], A[2], A[3], A[4], A[5], R(34), K[34]);
+    P(A[5], A[6], A[7], A[0], A[1], A[2], A[3], A[4], R(35), K[35]);
+    P(A[4], A[5], A[6], A[7], A[0], A[1], A[2], A[3], R(36), K[36]);
+    P(A[3], A[4], A[5], A[6], A[7], A[0], A[1], A[2], R(37), K[37]);
+    P(A[2], A[3], A[4], A[5], A[6], A[7], A[0], A[1], R(38), K[38]);
+    P(A[1], A[2], A[3], A[4], A[5], A[6], A[7], A[0], R(39), K[39]);
+    P(A[0], A[1], A[2], A[3], A[4], A[5], A[6], A[7], R(40), K[40]);
+    P(A[7], A[0], A[1], A[2], A[3], A[4], A[5], A[6], R(41), K[41]);
+    P(A[6], A[7], A[0], A[1], A[2], A[3], A[4], A[5], R(42), K[42]);
+    P(A[5], A[6], A[7], A[0], A[1], A[2], A[3], A[4], R(43), K[43]);
+    P(A[4], A[5], A[6], A[7], A[0], A[1], A[2], A[3], R(44), K[44]);
+    P(A[3], A[4], A[5], A[6], A[7], A[0], A[1], A[2], R(45), K[45]);
+    P(A[2], A[3], A[4], A[5], A[6], A[7], A[0], A[1], R(46), K[46]);
+    P(A[1], A[2], A[3], A[4], A[5], A[6], A[7], A[0], R(47), K[47]);
+    P(A[0], A[1], A[2], A[3], A[4], A[5], A[6], A[7], R(48), K[48]);
+    P(A[7], A[0], A[1], A[2], A[3], A[4], A[5], A[6], R(49), K[49]);
+    P(A[6], A[7], A[0], A[1], A[2], A[3], A[4], A[5], R(50), K[50]);
+    P(A[5], A[6], A[7], A[0], A[1], A[2], A[3], A[4], R(51), K[51]);
+    P(A[4], A[5], A[6], A[7], A[0], A[1], A[2], A[3], R(52), K[52]);
+    P(A[3], A[4], A[5], A[6], A[7], A[0], A[1], A[2], R(53), K[53]);
+    P(A[2], A[3], A[4], A[5], A[6], A[7], A[0], A[1], R(54), K[54]);
+    P(A[1], A[2], A[3], A[4], A[5], A[6], A[7], A[0], R(55), K[55]);
+    P(A[0], A[1], A[2], A[3], A[4], A[5], A[6], A[7], R(56), K[56]);
+    P(A[7], A[0], A[1], A[2], A[3], A[4], A[5], A[6], R(57), K[57]);
+    P(A[6], A[7], A[0], A[1], A[2], A[3], A[4], A[5], R(58), K[58]);
+    P(A[5], A[6], A[7], A[0], A[1], A[2], A[3], A[4], R(59), K[59]);
+
+    //Round 60 new e is the last hash word
+    temp1 = A[3] + S3(A[0]) + F1(A[0], A[1], A[2]) + K[60] + R(60);
+    if ((uint32_t)((A[7] + temp1) & 0xFFFF) != 0x32E7)
+        return false;
+    temp2 = S2(A[4]) + F0(A[4], A[5], A[6]);
+    A[7] += temp1;
+    A[3] = temp1 + temp2;
+
+    P(A[3], A[4], A[5], A[6], A[7], A[0], A[1], A[2], R(61), K[61]);
+    P(A[2], A[3], A[4], A[5], A[6], A[7], A[0], A[1], R(62), K[62]);
+    P(A[1], A[2], A[3], A[4], A[5], A[6], A[7], A[0], R(63), K[63]);
+
+    temp1 = 0x6A09E667 + A[0]; ((uint32_t*)doubleHash)[0] = (temp1 << 24) | ((temp1 << 8) & 0x00FF0000) | ((temp1 >> 8) & 0x0000FF00) | (temp1 >> 24);
+    temp1 = 0xBB67AE85 + A[1]; ((uint32_t*)doubleHash)[1] = (temp1 << 24) | ((temp1 << 8) & 0x00FF0000) | ((temp1 >> 8) & 0x0000FF00) | (temp1 >> 24);
+    temp1 = 0x3C6EF372 + A[2]; ((uint32_t*)doubleHash)[2] = (temp1 << 24) | ((temp1 << 8) & 0x00FF0000) | ((temp1 >> 8) & 0x0000FF00) | (temp1 >> 24);
+    temp1 = 0xA54FF53A + A[3]; ((uint32_t*)doubleHash)[3] = (temp1 << 24) | ((temp1 << 8) & 0x00FF0000) | ((temp1 >> 8) & 0x0000FF00) | (temp1 >> 24);
+    temp1 = 0x510E527F + A[4]; ((uint32_t*)doubleHash)[4] = (temp1 << 24) | ((temp1 << 8) & 0x00FF0000) | ((temp1 >> 8) & 0x0000FF00) | (temp1 >> 24);
+    temp1 = 0x9B05688C + A[5]; ((uint32_t*)doubleHash)[5] = (temp1 << 24) | ((temp1 << 8) & 0x00FF0000) | ((temp1 >> 8) & 0x0000FF00) | (temp1 >> 24);
+    temp1 = 0x1F83D9AB + A[6]; ((uint32_t*)doubleHash)[6] = (temp1 << 24) | ((temp1 << 8) & 0x00FF0000) | ((temp1 >> 8) & 0x0000FF00) | (temp1 >> 24);
+    temp1 = 0x5BE0CD19 + A[7]; ((uint32_t*)doubleHash)[7] = (temp1 << 24) | ((temp1 << 8) & 0x00FF0000) | ((temp1 >> 8) & 0x0000FF00) | (temp1 >> 24);
+    return true;
+}
+
+//*********** Two way interleaved sha256d ***********
+
+//One round on both states, the two dependency chains are independent so the
+//compiler can fill the Xtensa pipeline slots of one nonce with the other one
+#define P2(a, b, c, d, e, f, g, h, x, y, K)                                                                            \
+    {                                                                                                                  \
+        temp1 = A[h] + S3(A[e]) + F1(A[e], A[f], A[g]) + K + x;                                                        \
+        temp3 = B[h] + S3(B[e]) + F1(B[e], B[f], B[g]) + K + y;                                                        \
+        temp2 = S2(A[a]) + F0(A[a], A[b], A[c]);                                                                       \
+        temp4 = S2(B[a]) + F0(B[a], B[b], B[c]);                                                                       \
+        A[d] += temp1;                                                                                                 \
+        B[d] += temp3;                                                                                                 \
+        A[h] = temp1 + temp2;                                                                                          \
+        B[h] = temp3 + temp4;                                                                                          \
+    }
+
+#define R2(t)                                                                                                          \
+    {                                                                                                                  \
+        W[t] = S1(W[t - 2]) + W[t - 7] + S0(W[t - 15]) + W[t - 16];                                                    \
+        X[t] = S1(X[t - 2]) + X[t - 7] + S0(X[t - 15]) + X[t - 16];                                                    \
+    }
+
+#define P2_8(t, x, y)                                                                                                  \
+    {                                                                                                                  \
+        P2(0, 1, 2, 3, 4, 5, 6, 7, x[t + 0], y[t + 0], K[t + 0]);                                                      \
+        P2(7, 0, 1, 2, 3, 4, 5, 6, x[t + 1], y[t + 1], K[t + 1]);                                                      \
+        P2(6, 7, 0, 1, 2, 3, 4, 5, x[t + 2], y[t + 2], K[t + 2]);                                                      \
+        P2(5, 6, 7, 0, 1, 2, 3, 4, x[t + 3], y[t + 3], K[t + 3]);                                                      \
+        P2(4, 5, 6, 7, 0, 1, 2, 3, x[t + 4], y[t + 4], K[t + 4]);                                                      \
+        P2(3, 4, 5, 6, 7, 0, 1, 2, x[t + 5], y[t + 5], K[t + 5]);                                                      \
+        P2(2, 3, 4, 5, 6, 7, 0, 1, x[t + 6], y[t + 6], K[t + 6]);                                                      \
+        P2(1, 2, 3, 4, 5, 6, 7, 0, x[t + 7], y[t + 7], K[t + 7]);                                                      \
+    }
+
+IRAM_ATTR uint32_t nerd_sha256d_baked_x2(const uint32_t* digest, const uint8_t* dataIn, const uint32_t* bake, uint8_t* doubleHash)
+{
+    uint32_t temp1, temp2, temp3, temp4;
+
+    //Second nonce is the first one plus one, nonce is stored little endian
+    uint32_t nonce2;
+    memcpy(&nonce2, dataIn + 12, sizeof(nonce2));
+    nonce2++;
+
+    uint32_t W[64] = { bake[0], bake[1], bake[2], GET_UINT32_BE(dataIn, 12),
+                       0x80000000, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 640};
+    uint32_t X[64] = { bake[0], bake[1], bake[2], GET_UINT32_BE((const uint8_t*)&nonce2, 0),
+                       0x80000000, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 640};
+
+    W[16] = X[16] = bake[3];
+    W[17] = X[17] = bake[4];
+
+    const uint32_t* a = bake + 5;
+    uint32_t A[8] = { a[0], a[1], a[2], a[3],
+                      a[4], a[5], a[6], a[7] };
+    uint32_t B[8] = { a[0], a[1], a[2], a[3],
+                      a[4], a[5], a[6], a[7] };
+
+    //Round 3, same split as nerd_sha256d_baked()
+    temp1 = bake[13] + W[3];
+    temp3 = bake[13] + X[3];
+    A[0] += temp1;
+    B[0] += temp3;
+    A[4] = temp1 + bake[14];
+    B[4] = temp3 + bake[14];
+
+    P2(4, 5, 6, 7, 0, 1, 2, 3, W[4], X[4], K[4]);
+    P2(3, 4, 5, 6, 7, 0, 1, 2, W[5], X[5], K[5]);
+    P2(2, 3, 4, 5, 6, 7, 0, 1, W[6], X[6], K[6]);
+    P2(1, 2, 3, 4, 5, 6, 7, 0, W[7], X[7], K[7]);
+    P2_8(8, W, X);
+    P2(0, 1, 2, 3, 4, 5, 6, 7, W[16], X[16], K[16]);
+    P2(7, 0, 1, 2, 3, 4, 5, 6, W[17], X[17], K[17]);
+    for (int t = 18; t < 64; ++t)
+        R2(t);
+    P2(6, 7, 0, 1, 2, 3, 4, 5, W[18], X[18], K[18]);
+    P2(5, 6, 7, 0, 1, 2, 3, 4, W[19], X[19], K[19]);
+    P2(4, 5, 6, 7, 0, 1, 2, 3, W[20], X[20], K[20]);
+    P2(3, 4, 5, 6, 7, 0, 1, 2, W[21], X[21], K[21]);
+    P2(2, 3, 4, 5, 6, 7, 0, 1, W[22], X[22], K[22]);
+    P2(1, 2, 3, 4, 5, 6, 7, 0, W[23], X[23], K[23]);
+    P2_8(24, W, X);
+    P2_8(32, W, X);
+    P2_8(40, W, X);
+    P2_8(48, W, X);
+    P2_8(56, W, X);
+
+    /* Calculate the second hash (double SHA-256) */
+
+    for (int i = 0; i < 8; ++i)
+    {
+        W[i] = A[i] + digest[i];
+        X[i] = B[i] + digest[i];
+    }
+    W[8] = X[8] = 0x80000000;
+    for (int i = 9; i < 15; ++i)
+        W[i] = X[i] = 0;
+    W[15] = X[15] = 256;
+    for (int t = 16; t < 61; ++t)
+        R2(t);
+
+    A[0] = B[0] = 0x6A09E667;
+    A[1] = B[1] = 0xBB67AE85;
+    A[2] = B[2] = 0x3C6EF372;
+    A[3] = B[3] = 0xA54FF53A;
+    A[4] = B[4] = 0x510E527F;
+    A[5] = B[5] = 0x9B05688C;
+    A[6] = B[6] = 0x1F83D9AB;
+    A[7] = B[7] = 0x5BE0CD19;
+
+    P2_8(0, W, X);
+    P2_8(8, W, X);
+    P2_8(16, W, X);
+    P2_8(24, W, X);
+    P2_8(32, W, X);
+    P2_8(40, W, X);
+    P2_8(48, W, X);
+    P2(0, 1, 2, 3, 4, 5, 6, 7, W[56], X[56], K[56]);
+    P2(7, 0, 1, 2, 3, 4, 5, 6, W[57], X[57], K[57]);
+    P2(6, 7, 0, 1, 2, 3, 4, 5, W[58], X[58], K[58]);
+    P2(5, 6, 7, 0, 1, 2, 3, 4, W[59], X[59], K[59]);
+
+    //Round 60 only needs the new e, that is the last hash word
+    temp1 = A[7] + A[3] + S3(A[0]) + F1(A[0], A[1], A[2]) + K[60] + W[60];
+    temp3 = B[7] + B[3] + S3(B[0]) + F1(B[0], B[1], B[2]) + K[60] + X[60];
+
+    uint32_t mask = 0;
+    if ((uint32_t)(temp1 & 0xFFFF) == 0x32E7)
+        mask |= 1;
+    if ((uint32_t)(temp3 & 0xFFFF) == 0x32E7)
+        mask |= 2;
+    if (mask == 0)
+        return 0;
+
+    //Rare case, rebuild the full hash with the single nonce kernel
+    uint8_t tail[16];
+    memcpy(tail, dataIn, sizeof(tail));
+    if (mask & 1)
+        nerd_sha256d_baked(digest, tail, bake, doubleHash);
+    if (mask & 2)
+    {
+        memcpy(tail + 12, &nonce2, sizeof(nonce2));
+        nerd_sha256d_baked(digest, tail, bake, doubleHash + 32);
+    }
+    return mask;
+}
+
+//*********** Multi lane sha256d (host build) ***********
+
+#if defined(__SSE2__)
+
+//GCC vector extensions, v4 maps to SSE2 and v8 to AVX2 registers
+typedef uint32_t nerd_v4u __attribute__((vector_size(16)));
+typedef uint32_t nerd_v8u __attribute__((vector_size(32)));
+
+#define VROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+#define VS0(x) (VROTR(x, 7) ^ VROTR(x, 18) ^ SHR(x, 3))
+#define VS1(x) (VROTR(x, 17) ^ VROTR(x, 19) ^ SHR(x, 10))
+
+#define VS2(x) (VROTR(x, 2) ^ VROTR(x, 13) ^ VROTR(x, 22))
+#define VS3(x) (VROTR(x, 6) ^ VROTR(x, 11) ^ VROTR(x, 25))
+
+#define VR(t) (W[t] = VS1(W[t - 2]) + W[t - 7] + VS0(W[t - 15]) + W[t - 16])
+
+#define VP(a, b, c, d, e, f, g, h, x, K)                                                                               \
+    {                                                                                                                  \
+        temp1 = h + VS3(e) + F1(e, f, g) + K + x;                                                                      \
+        temp2 = VS2(a) + F0(a, b, c);                                                                                  \
+        d += temp1;                                                                                                    \
+        h = temp1 + temp2;                                                                                             \
+    }
+
+//Same rounds as nerd_sha256d_baked() but one nonce per vector lane, stops after round 60 of the second hash
+//and returns the lanes whose last word can still end with 16 zero bits
+template <typename V, int LANES>
+static inline __attribute__((always_inline)) uint32_t nerd_sha256d_baked_lanes(const uint32_t* digest, const uint32_t* bake, uint32_t nonce)
+{
+    V temp1, temp2;
+    V W[64];
+
+    for (int i = 0; i < LANES; ++i)
+        W[3][i] = __builtin_bswap32(nonce + i);
+
+    W[0] = bake[0] + (V){};
+    W[1] = bake[1] + (V){};
+    W[2] = bake[2] + (V){};
+    W[4] = 0x80000000 + (V){};
+    for (int i = 5; i < 15; ++i)
+        W[i] = (V){};
+    W[15] = 640 + (V){};
+    W[16] = bake[3] + (V){};
+    W[17] = bake[4] + (V){};
+
+    const uint32_t* a = bake + 5;
+    V A[8];
+    for (int i = 0; i < 8; ++i)
+        A[i] = a[i] + (V){};
+
+    temp1 = bake[13] + W[3];
+    temp2 = bake[14] + (V){};
+    A[0] += temp1;
+    A[4] = temp1 + temp2;
+
+    VP(A[4], A[5], A[6], A[7], A[0], A[1], A[2], A[3], W[4], K[4]);
+    VP(A[3], A[4], A[5], A[6], A[7], A[0], A[1], A[2], W[5], K[5]);
+    VP(A[2], A[3], A[4], A[5], A[6], A[7], A[0], A[1], W[6], K[6]);
+    VP(A[1], A[2], A[3], A[4], A[5], A[6], A[7], A[0], W[7], K[7]);
+    for (int t = 8; t < 16; t += 8)
+    {
+        VP(A[0], A[1], A[2], A[3], A[4], A[5], A[6], A[7], W[t + 0], K[t + 0]);
+        VP(A[7], A[0], A[1], A[2], A[3], A[4], A[5], A[6], W[t + 1], K[t + 1]);
+        VP(A[6], A[7], A[0], A[1], A[2], A[3], A[4], A[5], W[t + 2], K[t + 2]);
+        VP(A[5], A[6], A[7], A[0], A[1], A[2], A[3], A[4], W[t + 3], K[t + 3]);
+        VP(A[4], A[5], A[6], A[7], A[0], A[1], A[2], A[3], W[t + 4], K[t + 4]);
+        VP(A[3], A[4], A[5], A[6], A[7], A[0], A[1], A[2], W[t + 5], K[t + 5]);
+        VP(A[2], A[3], A[4], A[5], A[6], A[7], A[0], A[1], W[t + 6], K[t + 6]);
+        VP(A[1], A[2], A[3], A[4], A[5], A[6], A[7], A[0], W[t + 7], K[t + 7]);
+    }
+    VP(A[0], A[1], A[2], A[3], A[4], A[5], A[6], A[7], W[16], K[16]);
+    VP(A[7], A[0], A[1], A[2], A[3], A[4], A[5], A[6], W[17], K[17]);
+    VP(A[6], A[7], A[0], A[1], A[2], A[3], A[4], A[5], VR(18), K[18]);
+    VP(A[5], A[6], A[7], A[0], A[1], A[2], A[3], A[4], VR(19), K[19]);
+    VP(A[4], A[5], A[6], A[7], A[0], A[1], A[2], A[3], VR(20), K[20]);
+    VP(A[3], A[4], A[5], A[6], A[7], A[0], A[1], A[2], VR(21), K[21]);
+    VP(A[2], A[3], A[4], A[5], A[6], A[7], A[0], A[1], VR(22), K[22]);
+    VP(A[1], A[2], A[3], A[4], A[5], A[6], A[7], A[0], VR(23), K[23]);
+    for (int t = 24; t < 64; t += 8)
+    {
+        VP(A[0], A[1], A[2], A[3], A[4], A[5], A[6], A[7], VR(t + 0), K[t + 0]);
+        VP(A[7], A[0], A[1], A[2], A[3], A[4], A[5], A[6], VR(t + 1), K[t + 1]);
+        VP(A[6], A[7], A[0], A[1], A[2], A[3], A[4], A[5], VR(t + 2), K[t + 2]);
+        VP(A[5], A[6], A[7], A[0], A[1], A[2], A[3], A[4], VR(t + 3), K[t + 3]);
+        VP(A[4], A[5], A[6], A[7], A[0], A[1], A[2], A[3], VR(t + 4), K[t + 4]);
+        VP(A[3], A[4], A[5], A[6], A[7], A[0], A[1], A[2], VR(t + 5), K[t + 5]);
+        VP(A[2], A[3], A[4], A[5], A[6], A[7], A[0], A[1], VR(t + 6), K[t + 6]);
+        VP(A[1], A[2], A[3], A[4], A[5], A[6], A[7], A[0], VR(t + 7), K[t + 7]);
+    }
+
+    /* Calculate the second hash (double SHA-256) */
+
+    for (int i = 0; i < 8; ++i)
+        W[i] = A[i] + digest[i];
+    W[8] = 0x80000000 + (V){};
+    for (int i = 9; i < 15; ++i)
+        W[i] = (V){};
+    W[15] = 256 + (V){};
+
+    A[0] = 0x6A09E667 + (V){};
+    A[1] = 0xBB67AE85 + (V){};
+    A[2] = 0x3C6EF372 + (V){};
+    A[3] = 0xA54FF53A + (V){};
+    A[4] = 0x510E527F + (V){};
+    A[5] = 0x9B05688C + (V){};
+    A[6] = 0x1F83D9AB + (V){};
+    A[7] = 0x5BE0CD19 + (V){};
+
+    for (int t = 0; t < 16; t += 8)
+    {
+        VP(A[0], A[1], A[2], A[3], A[4], A[5], A[6], A[7], W[t + 0], K[t + 0]);
+        VP(A[7], A[0], A[1], A[2], A[3], A[4], A[5], A[6], W[t + 1], K[t + 1]);
+        VP(A[6], A[7], A[0], A[1], A[2], A[3], A[4], A[5], W[t + 2], K[t + 2]);
+        VP(A[5], A[6], A[7], A[0], A[1], A[2], A[3], A[4], W[t + 3], K[t + 3]);
+        VP(A[4], A[5], A[6], A[7], A[0], A[1], A[2], A[3], W[t + 4], K[t + 4]);
+        VP(A[3], A[4], A[5], A[6], A[7], A[0], A[1], A[2], W[t + 5], K[t + 5]);
+        VP(A[2], A[3], A[4], A[5], A[6], A[7], A[0], A[1], W[t + 6], K[t + 6]);
+        VP(A[1], A[2], A[3], A[4], A[5], A[6], A[7], A[0], W[t + 7], K[t + 7]);
+    }
+    for (int t = 16; t < 56; t += 8)
+    {
+        VP(A[0], A[1], A[2], A[3], A[4], A[5], A[6], A[7], VR(t + 0), K[t + 0]);
+        VP(A[7], A[0], A[1], A[2], A[3], A[4], A[5], A[6], VR(t + 1), K[t + 1]);
+        VP(A[6], A[7], A[0], A[1], A[2], A[3], A[4], A[5], VR(t + 2), K[t + 2]);
+        VP(A[5], A[6], A[7], A[0], A[1], A[2], A[3], A[4], VR(t + 3), K[t + 3]);
+        VP(A[4], A[5], A[6], A[7], A[0], A[1], A[2], A[3], VR(t + 4), K[t + 4]);
+        VP(A[3], A[4], A[5], A[6], A[7], A[0], A[1], A[2], VR(t + 5), K[t + 5]);
+        VP(A[2], A[3], A[4], A[5], A[6], A[7], A[0], A[1], VR(t + 6), K[t + 6]);
+        VP(A[1], A[2], A[3], A[4], A[5], A[6], A[7], A[0], VR(t + 7), K[t + 7]);
+    }
+    VP(A[0], A[1], A[2], A[3], A[4], A[5], A[6], A[7], VR(56), K[56]);
+    VP(A[7], A[0], A[1], A[2], A[3], A[4], A[5], A[6], VR(57), K[57]);
+    VP(A[6], A[7], A[0], A[1], A[2], A[3], A[4], A[5], VR(58), K[58]);
+    VP(A[5], A[6], A[7], A[0], A[1], A[2], A[3], A[4], VR(59), K[59]);
+    //Round 60 only needs the new e, that is the last hash word
+    temp1 = A[3] + VS3(A[0]) + F1(A[0], A[1], A[2]) + K[60] + VR(60);
+    V a7 = A[7] + temp1;
+
+    uint32_t mask = 0;
+    for (int i = 0; i < LANES; ++i)
+        if ((uint32_t)(a7[i] & 0xFFFF) == 0x32E7)
+            mask |= 1 << i;
+    return mask;
+}
+
+static uint32_t nerd_sha256d_baked_x4(const uint32_t* digest, uint32_t nonce, const uint32_t* bake)
+{
+    return nerd_sha256d_baked_lanes<nerd_v4u, 4>(digest, bake, nonce);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2")))
+static uint32_t nerd_sha256d_baked_x8(const uint32_t* digest, uint32_t nonce, const uint32_t* bake)
+{
+    return nerd_sha256d_baked_lanes<nerd_v8u, 8>(digest, bake, nonce);
+}
+#endif
+
+#endif  //__SSE2__
+
+uint32_t nerd_sha256d_lanes(void)
+{
+#if defined(__SSE2__) && (defined(__x86_64__) || defined(__i386__))
+    static uint32_t s_lanes = 0;
+    if (s_lanes == 0)
+        s_lanes = __builtin_cpu_supports("avx2") ? 8 : 4;
+    return s_lanes;
+#elif defined(__SSE2__)
+    return 4;
+#else
+    return 2;
+#endif
+}
+
+uint32_t nerd_sha256d_baked_xN(const uint32_t* digest, const uint8_t* dataIn, const uint32_t* bake, uint8_t* doubleHash)
+{
+#if defined(__SSE2__)
+    uint32_t nonce;
+    memcpy(&nonce, dataIn + 12, sizeof(nonce));
+
+    uint32_t lanes = nerd_sha256d_lanes();
+    uint32_t mask;
+#if defined(__x86_64__) || defined(__i386__)
+    if (lanes == 8)
+        mask = nerd_sha256d_baked_x8(digest, nonce, bake);
+    else
+#endif
+        mask = nerd_sha256d_baked_x4(digest, nonce, bake);
+
+    //~1 lane in 65536 gets here, finish it with the scalar kernel
+    if (mask)
+    {
+        uint8_t tail[16];
+        memcpy(tail, dataIn, sizeof(tail));
+        for (uint32_t i = 0; i < lanes; ++i)
+        {
+            if ((mask & (1 << i)) == 0)
+                continue;
+            uint32_t lane_nonce = nonce + i;
+            memcpy(tail + 12, &lane_nonce, sizeof(lane_nonce));
+            nerd_sha256d_baked(digest, tail, bake, doubleHash + 32 * i);
+        }
+    }
+    return mask;
+#else
+    return nerd_sha256d_baked_x2(digest, dataIn, bake, doubleHash);
+#endif
 }
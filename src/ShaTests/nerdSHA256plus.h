@@ -18,6 +18,15 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#ifdef NATIVE_TEST
+#ifndef IRAM_ATTR
+#define IRAM_ATTR
+#endif
+#ifndef DRAM_ATTR
+#define DRAM_ATTR
+#endif
+#endif
+
 
 struct nerdSHA256_context {
     uint8_t buffer[64];
@@ -32,6 +41,56 @@ IRAM_ATTR bool nerd_sha256d(nerdSHA256_context* midstate, const uint8_t* dataIn,
 IRAM_ATTR void nerd_sha256_bake(const uint32_t* digest, const uint8_t* dataIn, uint32_t* bake);  //15 words
 IRAM_ATTR bool nerd_sha256d_baked(const uint32_t* digest, const uint8_t* dataIn, const uint32_t* bake, uint8_t* doubleHash);
 
+/* Deep bake, bake plus every nonce independent term of both blocks. Same result as nerd_sha256d_baked() */
+#define NERD_DEEPBAKE_WORDS 33
+IRAM_ATTR void nerd_sha256_deepbake(const uint32_t* digest, const uint8_t* dataIn, uint32_t* deepbake);  //NERD_DEEPBAKE_WORDS words
+IRAM_ATTR bool nerd_sha256d_deepbaked(const uint32_t* digest, const uint8_t* dataIn, const uint32_t* deepbake, uint8_t* doubleHash);
+
+/* Two nonces interleaved, the one stored in dataIn+12 and the next one. Same bake layout and result as
+   nerd_sha256d_baked(), returns a bitmask of the nonces that passed, hashes go to doubleHash and doubleHash+32 */
+IRAM_ATTR uint32_t nerd_sha256d_baked_x2(const uint32_t* digest, const uint8_t* dataIn, const uint32_t* bake, uint8_t* doubleHash);
+
+/* Multi lane sha256d, hashes nerd_sha256d_lanes() consecutive nonces starting at the one stored in dataIn+12.
+   Returns a bitmask of the lanes that passed the 16bit early reject, only those lanes are written to
+   doubleHash + 32*lane, so doubleHash must hold NERD_SHA256D_MAX_LANES*32 bytes.
+   Without SSE2 (ESP32) this is nerd_sha256d_baked_x2() */
+#define NERD_SHA256D_MAX_LANES 8
+uint32_t nerd_sha256d_lanes(void);
+uint32_t nerd_sha256d_baked_xN(const uint32_t* digest, const uint8_t* dataIn, const uint32_t* bake, uint8_t* doubleHash);
+
+/* Template round engine, fully unrolled sha256d specialised at compile time
+   BAKED       0 first block from the midstate (bake unused), 3 from nerd_sha256_bake()
+   EARLY_EXIT  0 always full hash, 60 16bit early reject after round 60 of the second block
+   OUT_BE      1 big endian hash bytes like the hand written kernels, 0 native endian words
+   Built variants: <0,0,1> <0,60,1> <3,0,0> <3,0,1> <3,60,1>
+   nerd_sha256d() and nerd_sha256d_baked() run on it when NERD_SHA256_ENGINE is set, which is the
+   default on native only. The boards keep the hand written kernels until the engine wins the A/B
+   of test_performance_benchmark on them, -D NERD_SHA256_ENGINE or -D NERD_SHA256_HANDWRITTEN
+   picks one on any target */
+#if defined(NATIVE_TEST) && !defined(NERD_SHA256_ENGINE) && !defined(NERD_SHA256_HANDWRITTEN)
+#define NERD_SHA256_ENGINE
+#endif
+template <int BAKED, int EARLY_EXIT, int OUT_BE>
+bool nerd_sha256d_engine(const uint32_t* digest, const uint8_t* dataIn, const uint32_t* bake, uint8_t* doubleHash);
+
+/* sha256d of exactly 64 bytes (two concatenated hashes, a merkle node), hash bytes in the same order as mbedtls.
+   The batch form hashes count consecutive 64 byte inputs into count*32 bytes */
+IRAM_ATTR void nerd_sha256d_64(const uint8_t* dataIn, uint8_t* doubleHash);
+void nerd_sha256d_64_batch(const uint8_t* dataIn, uint8_t* doubleHash, size_t count);
+
+/* Streaming sha256d for messages of any length (the coinbase). The context is plain data, a copy taken
+   after nerd_sha256_update() is a prefix midstate that can be finished with different tails.
+   nerd_sha256d_finish() leaves ctx untouched, hash bytes in the same order as mbedtls */
+struct nerdSHA256_stream {
+    uint32_t digest[8];
+    uint8_t buffer[64];
+    uint32_t length;
+};
+
+void nerd_sha256_start(nerdSHA256_stream* ctx);
+void nerd_sha256_update(nerdSHA256_stream* ctx, const uint8_t* dataIn, size_t len);
+void nerd_sha256d_finish(const nerdSHA256_stream* ctx, uint8_t* doubleHash);
+
 void ByteReverseWords(uint32_t* out, const uint32_t* in, uint32_t byteCount);
 
 #endif /* nerdSHA256plus_H_ */
\ No newline at end of file
@@ -0,0 +1,102 @@
+#ifndef JOB_RING_API_H
+#define JOB_RING_API_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+/*
+ * Fixed capacity multi producer / multi consumer ring of preallocated slots
+ * (bounded queue with a sequence number per slot). push() and pop() copy the
+ * value in and out, never allocate and never block, they return false when
+ * the ring is full or empty. N must be a power of two
+ */
+#define JOB_RING_ALIGN 64   //Keeps head and tail on their own cache lines on host builds
+
+template <typename T, uint32_t N>
+class JobRing
+{
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "JobRing capacity must be a power of two");
+
+public:
+  JobRing()
+  {
+    for (uint32_t i = 0; i < N; ++i)
+      slots[i].seq.store(i, std::memory_order_relaxed);
+    head.store(0, std::memory_order_relaxed);
+    tail.store(0, std::memory_order_relaxed);
+  }
+
+  bool push(const T& value)
+  {
+    uint32_t pos = tail.load(std::memory_order_relaxed);
+    Slot* slot;
+    while (true)
+    {
+      slot = &slots[pos & (N - 1)];
+      int32_t dif = (int32_t)(slot->seq.load(std::memory_order_acquire) - pos);
+      if (dif == 0)
+      {
+        if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          break;
+      } else if (dif < 0)
+        return false;  //full
+      else
+        pos = tail.load(std::memory_order_relaxed);
+    }
+    slot->value = value;
+    slot->seq.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool pop(T& value)
+  {
+    uint32_t pos = head.load(std::memory_order_relaxed);
+    Slot* slot;
+    while (true)
+    {
+      slot = &slots[pos & (N - 1)];
+      int32_t dif = (int32_t)(slot->seq.load(std::memory_order_acquire) - (pos + 1));
+      if (dif == 0)
+      {
+        if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          break;
+      } else if (dif < 0)
+        return false;  //empty
+      else
+        pos = head.load(std::memory_order_relaxed);
+    }
+    value = slot->value;
+    slot->seq.store(pos + N, std::memory_order_release);
+    return true;
+  }
+
+  //Snapshot, exact only when no other task is pushing or popping
+  uint32_t size() const
+  {
+    return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+  }
+
+  //Drops everything queued, pops with a scratch value so call it from a task with stack to spare
+  void clear()
+  {
+    T scratch;
+    while (pop(scratch))
+      ;
+  }
+
+  static constexpr uint32_t capacity() { return N; }
+
+private:
+  struct Slot
+  {
+    std::atomic<uint32_t> seq;
+    T value;
+  };
+
+  alignas(JOB_RING_ALIGN) std::atomic<uint32_t> head;
+  alignas(JOB_RING_ALIGN) std::atomic<uint32_t> tail;
+  alignas(JOB_RING_ALIGN) Slot slots[N];
+};
+
+#endif // JOB_RING_API_H
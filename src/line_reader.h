@@ -0,0 +1,99 @@
+#ifndef LINE_READER_API_H
+#define LINE_READER_API_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Fixed size receive buffer that frames '\n' terminated lines without
+ * allocating. Bytes are read straight into space()/commit(), next() yields
+ * each complete line as a view into the buffer, '\r' stripped and NUL
+ * terminated in place. A view stays valid until the next space() call, which
+ * moves the unread bytes to the front. Lines that don't fit in N - 1 bytes
+ * are dropped up to their '\n' and counted in dropped()
+ */
+template <uint32_t N>
+class LineReader
+{
+  static_assert(N >= 2, "LineReader needs room for a line and its terminator");
+
+public:
+  LineReader() : lines_dropped(0) { clear(); }
+
+  //Free space at the end of the buffer, commit() what was written there
+  char* space(uint32_t &len)
+  {
+    if (head > 0)
+    {
+      memmove(buffer, buffer + head, tail - head);
+      scan -= head;
+      tail -= head;
+      head = 0;
+    }
+    len = N - 1 - tail;
+    return buffer + tail;
+  }
+
+  void commit(uint32_t len)
+  {
+    tail += len;
+  }
+
+  //Next complete line, false when the bytes buffered don't end one yet
+  bool next(const char* &line, uint32_t &len)
+  {
+    while (true)
+    {
+      const char* end = (const char*)memchr(buffer + scan, '\n', tail - scan);
+      if (end == NULL)
+      {
+        scan = tail;
+        if (tail - head < N - 1)
+          return false;
+        //Full without a line end, drop what we have until the '\n' shows up
+        discarding = true;
+        head = scan = tail = 0;
+        return false;
+      }
+
+      uint32_t start = head;
+      uint32_t stop = end - buffer;
+      head = scan = stop + 1;
+      if (discarding)
+      {
+        discarding = false;
+        lines_dropped++;
+        continue;
+      }
+      if (stop > start && buffer[stop - 1] == '\r')
+        stop--;
+      buffer[stop] = '\0';
+      line = buffer + start;
+      len = stop - start;
+      return true;
+    }
+  }
+
+  //Drops the bytes buffered, on a new connection
+  void clear()
+  {
+    head = scan = tail = 0;
+    discarding = false;
+  }
+
+  //Bytes received and not yet returned as a line
+  uint32_t size() const { return tail - head; }
+  uint32_t dropped() const { return lines_dropped; }
+  static constexpr uint32_t capacity() { return N - 1; }
+
+private:
+  char buffer[N];
+  uint32_t head;    //first byte not returned yet
+  uint32_t scan;    //bytes before it have no '\n'
+  uint32_t tail;    //end of the bytes received
+  bool discarding;  //inside a line too long for the buffer
+  uint32_t lines_dropped;
+};
+
+#endif // LINE_READER_API_H
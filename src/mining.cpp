@@ -13,13 +13,14 @@
 #include "timeconst.h"
 #include "drivers/displays/display.h"
 #include "drivers/storage/storage.h"
-#include <mutex>
-#include <list>
-#include <map>
+#include <atomic>
 #include "mbedtls/sha256.h"
 #include "i2c_master.h"
+#include "job_ring.h"
+#include "line_reader.h"
+#include "submit_tracker.h"
 
-//10 Jobs per second
+//First claim of each worker, the chunk tuner sizes the next ones from the measured hash rate
 #define NONCE_PER_JOB_SW 4096
 #define NONCE_PER_JOB_HW 16*1024
 
@@ -27,7 +28,7 @@
 
 //#define SHA256_VALIDATE
 //#define RANDOM_NONCE
-#define RANDOM_NONCE_MASK 0xFFFFC000
+#define RANDOM_NONCE_MASK 0xFFFFC000  //Random starts and blocks hashed in random order are this aligned
 
 #ifdef HARDWARE_SHA265
 #include <sha/sha_dma.h>
@@ -43,15 +44,22 @@
 nvs_handle_t stat_handle;
 
 uint32_t templates = 0;
-uint32_t hashes = 0;
 uint32_t Mhashes = 0;
 uint32_t totalKHashes = 0;
 uint32_t elapsedKHs = 0;
 uint64_t upTime = 0;
+static uint64_t totalHashes = 0;  //Summed from the miner stats by the monitor
 
 volatile uint32_t shares; // increase if blockhash has 32 bits of zeroes
 volatile uint32_t valids; // increased if blockhash <= target
 
+// Job switch latency, notify received to first range of the new job claimed by a miner
+volatile uint32_t jobSwitchLatency_us = 0;
+volatile uint32_t jobSwitchLatencyMax_us = 0;
+
+// Shares sent and the pool's answers, with their round trip times
+SubmitStats submitStats;
+
 // Track best diff
 double best_diff = 0.0;
 
@@ -63,9 +71,10 @@ IPAddress serverIP(1, 1, 1, 1); //Temporally save poolIPaddres
 
 //Global work data 
 static WiFiClient client;
+static LineReader<BUFFER_LINE> s_pool_lines; //Pool messages of the current connection, read without blocking
 static miner_data mMiner; //Global miner data (Create a miner class TODO)
+static coinbase_midstate mCoinbase; //Coinbase prefix midstate of the current job
 mining_subscribe mWorker;
-mining_job mJob;
 monitor_data mMonitor;
 static bool volatile isMinerSuscribed = false;
 unsigned long mLastTXtoPool = millis();
@@ -98,18 +107,34 @@ bool checkPoolConnection(void) {
     return false;
   }
 
+  s_pool_lines.clear();
   return true;
 }
 
+//Next message from the pool, a view into s_pool_lines valid until the next call.
+//Reads only the bytes already received
+static bool PoolLineNext(const char* &line, uint32_t &len)
+{
+  if (s_pool_lines.next(line, len))
+    return true;
+  int available = client.available();
+  if (available <= 0)
+    return false;
+  uint32_t space;
+  char* at = s_pool_lines.space(space);
+  int received = client.read((uint8_t*)at, (uint32_t)available < space ? available : space);
+  if (received <= 0)
+    return false;
+  s_pool_lines.commit(received);
+  return s_pool_lines.next(line, len);
+}
+
 //Implements a socketKeepAlive function and 
 //checks if pool is not sending any data to reconnect again.
 //Even connection could be alive, pool could stop sending new job NOTIFY
 unsigned long mStart0Hashrate = 0;
 bool checkPoolInactivity(unsigned int keepAliveTime, unsigned long inactivityTime){ 
 
-    unsigned long currentKHashes = (Mhashes*1000) + hashes/1000;
-    unsigned long elapsedKHs = currentKHashes - totalKHashes;
-
     uint32_t time_now = millis();
 
     // If no shares sent to pool
@@ -139,68 +164,280 @@ bool checkPoolInactivity(unsigned int keepAliveTime, unsigned long inactivityTim
   return false;
 }
 
+//Private copy of a claimed range, filled by WorkClaim()
 struct JobRequest
 {
   uint32_t id;
+  uint64_t extranonce2;
+  uint32_t version;
+  uint32_t ntime;
   uint32_t nonce_start;
   uint32_t nonce_count;
   double difficulty;
+  uint256 target;
   uint8_t sha_buffer[128];
   uint32_t midstate[8];
   uint32_t bake[16];
 };
 
+//Hash below the share target, hashes counts go to the miner stats
 struct JobResult
 {
   uint32_t id;
+  uint64_t extranonce2;
+  uint32_t version;
+  uint32_t ntime;
   uint32_t nonce;
-  uint32_t nonce_count;
   double difficulty;
   uint8_t hash[32];
 };
 
-static std::mutex s_job_mutex;
-std::list<std::shared_ptr<JobRequest>> s_job_request_list_sw;
-#ifdef HARDWARE_SHA265
-std::list<std::shared_ptr<JobRequest>> s_job_request_list_hw;
-#endif
-std::list<std::shared_ptr<JobResult>> s_job_result_list;
-static volatile uint8_t s_working_current_job_id = 0xFF;
+//Best hashes of one chunk below the share target. Once full, a new one has to beat the
+//worst kept and replaces it, so the hot loops compare against threshold only
+#define CANDIDATES_MAX 4
+struct Candidates
+{
+  uint32_t count;
+  uint32_t worst;     //index of the highest hash once full
+  uint256 threshold;  //share target until full
+  JobResult found[CANDIDATES_MAX];
+};
+
+static inline void CandidatesStart(Candidates &c, const JobRequest* job)
+{
+  c.count = 0;
+  c.threshold = job->target;
+}
+
+//hash is below c.threshold
+static void CandidatesAdd(Candidates &c, const JobRequest* job, uint32_t nonce, const uint8_t* hash)
+{
+  JobResult &r = c.found[c.count < CANDIDATES_MAX ? c.count++ : c.worst];
+  r.id = job->id;
+  r.extranonce2 = job->extranonce2;
+  r.version = job->version;
+  r.ntime = job->ntime;
+  r.nonce = nonce;
+  memcpy(r.hash, hash, sizeof(r.hash));
+  if (c.count < CANDIDATES_MAX)
+    return;
+
+  c.worst = 0;
+  for (uint32_t i = 1; i < CANDIDATES_MAX; ++i)
+  {
+    uint256 value;
+    uint256_from_hash(c.found[i].hash, &value);
+    if (uint256_hash_below(c.found[c.worst].hash, &value))
+      c.worst = i;
+  }
+  uint256_from_hash(c.found[c.worst].hash, &c.threshold);
+}
+
+//Preallocated lock free ring, the miners queue candidates and the stratum task consumes them
+static JobRing<JobResult, 16> s_job_result_ring;
+//Job generations, the 32bit job_pool of the stratum task (0xFFFFFFFF while stopped).
+//Ranges of any other generation are stale and the miners abort them
+static std::atomic<uint32_t> s_job_generation(0xFFFFFFFF);
+//Job whose ranges in flight may still finish, same as the current one after a clean_jobs notify
+static std::atomic<uint32_t> s_job_generation_previous(0xFFFFFFFF);
+//micros() of the last generation change, stored before the generations
+static std::atomic<uint32_t> s_job_generation_us(0);
+
+static inline bool JobStale(uint32_t generation)
+{
+  return generation != s_job_generation.load(std::memory_order_acquire) &&
+         generation != s_job_generation_previous.load(std::memory_order_acquire);
+}
 
-static void JobPush(std::list<std::shared_ptr<JobRequest>> &job_list,  uint32_t id, uint32_t nonce_start, uint32_t nonce_count, double difficulty,
-                    const uint8_t* sha_buffer, const uint32_t* midstate, const uint32_t* bake)
+static void JobGenerationSet(uint32_t generation, uint32_t previous)
 {
-  std::shared_ptr<JobRequest> job = std::make_shared<JobRequest>();
-  job->id = id;
-  job->nonce_start = nonce_start;
-  job->nonce_count = nonce_count;
-  job->difficulty = difficulty;
-  memcpy(job->sha_buffer, sha_buffer, sizeof(job->sha_buffer));
-  memcpy(job->midstate, midstate, sizeof(job->midstate));
-  memcpy(job->bake, bake, sizeof(job->bake));
-  job_list.push_back(job);
+  s_job_generation_us.store(micros(), std::memory_order_relaxed);
+  s_job_generation_previous.store(previous, std::memory_order_release);
+  s_job_generation.store(generation, std::memory_order_release);
 }
 
-struct Submition
+//Idle miners sleep on a task notification until work is published, the stratum task
+//is notified for each result. The timeouts only bound a missed registration
+#define WORK_MAX_MINERS 4
+#define WORK_IDLE_WAIT_MS 100
+static std::atomic<TaskHandle_t> s_miner_tasks[WORK_MAX_MINERS];
+static TaskHandle_t s_stratum_task = NULL;
+
+enum MinerEngine
+{
+  MINER_ENGINE_NONE,
+  MINER_ENGINE_SW,
+  MINER_ENGINE_HW,
+  MINER_ENGINE_I2C
+};
+
+//Counters of one miner, written by that miner only and summed by the monitor. The 32bit
+//counters wrap, the monitor adds up their deltas. Each block has its own cache line. The
+//MINER_STATS_I2C block has several writers, the stratum task and any extra miners
+#define MINER_STATS_ALIGN 64
+#define MINER_STATS_I2C WORK_MAX_MINERS  //Slaves, and miners past WORK_MAX_MINERS
+struct alignas(MINER_STATS_ALIGN) MinerStats
 {
-  double diff;
-  bool is32bit;
-  bool isValid;
+  std::atomic<uint32_t> hashes;
+  std::atomic<uint32_t> candidates;  //hashes below the share target
+  std::atomic<uint32_t> dropped;     //candidates lost to a full result ring
+  std::atomic<uint32_t> busy_us;
+  std::atomic<uint32_t> idle_us;
+  std::atomic<uint32_t> stale_hashes;  //estimated, hashed after the range went stale
+  std::atomic<uint32_t> abort_max_us;  //longest time from a range going stale to its abort
+  std::atomic<float> best_diff;
+  std::atomic<uint8_t> engine;
 };
+static MinerStats s_miner_stats[WORK_MAX_MINERS + 1];
+
+static inline bool StatShared(const MinerStats &stats)
+{
+  return &stats == &s_miner_stats[MINER_STATS_I2C];
+}
+
+//Single writer, a load and a store are enough and cheaper than an atomic add. The shared block adds atomically
+static inline void StatAdd(MinerStats &stats, std::atomic<uint32_t> &counter, uint32_t value)
+{
+  if (StatShared(stats))
+    counter.fetch_add(value, std::memory_order_relaxed);
+  else
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
 
-static void MiningJobStop(uint32_t &job_pool, std::map<uint32_t, std::shared_ptr<Submition>> & submition_map)
+//Keeps the largest value, with a compare and swap on the shared block
+template <typename T>
+static inline void StatMax(MinerStats &stats, std::atomic<T> &counter, T value)
 {
+  T current = counter.load(std::memory_order_relaxed);
+  while (value > current)
   {
-    std::lock_guard<std::mutex> lock(s_job_mutex);
-    s_job_result_list.clear();
-    s_job_request_list_sw.clear();
-    #ifdef HARDWARE_SHA265
-    s_job_request_list_hw.clear();
+    if (!StatShared(stats))
+    {
+      counter.store(value, std::memory_order_relaxed);
+      return;
+    }
+    if (counter.compare_exchange_weak(current, value, std::memory_order_relaxed))
+      return;
+  }
+}
+
+static MinerStats& MinerRegister(MinerEngine engine)
+{
+  TaskHandle_t self = xTaskGetCurrentTaskHandle();
+  for (int i = 0; i < WORK_MAX_MINERS; ++i)
+  {
+    TaskHandle_t empty = NULL;
+    if (s_miner_tasks[i].compare_exchange_strong(empty, self))
+    {
+      s_miner_stats[i].engine.store(engine, std::memory_order_relaxed);
+      return s_miner_stats[i];
+    }
+  }
+  Serial.println("More miners than WORK_MAX_MINERS, the extra ones poll for work");
+  s_miner_stats[MINER_STATS_I2C].engine.store(engine, std::memory_order_relaxed);
+  return s_miner_stats[MINER_STATS_I2C];
+}
+
+//Per miner buffers kept off the task stacks, one per registered miner. Miners past
+//WORK_MAX_MINERS share a stats block, they allocate theirs once instead
+template <typename T>
+static T& MinerBuffer(T (&buffers)[WORK_MAX_MINERS], const MinerStats &stats)
+{
+  if (StatShared(stats))
+    return *new T();
+  return buffers[&stats - s_miner_stats];
+}
+
+//Range each miner claimed last, and the best hashes of its chunk
+static JobRequest s_miner_jobs[WORK_MAX_MINERS];
+static Candidates s_miner_found[WORK_MAX_MINERS];
+
+//Accounts a finished chunk and queues its candidates, only they need a float difficulty
+static void MinerChunkDone(MinerStats &stats, const JobRequest* job, Candidates &found, uint32_t nonces_done, uint32_t busy_us)
+{
+  StatAdd(stats, stats.hashes, nonces_done);
+  StatAdd(stats, stats.busy_us, busy_us);
+  if (JobStale(job->id))
+  {
+    //Hashed at a steady rate, so the stale part of the chunk is its stale part of busy_us
+    uint32_t stale_us = micros() - s_job_generation_us.load(std::memory_order_relaxed);
+    StatMax(stats, stats.abort_max_us, stale_us);
+    if (busy_us > 0)
+      StatAdd(stats, stats.stale_hashes, stale_us < busy_us ? (uint32_t)((uint64_t)nonces_done * stale_us / busy_us) : nonces_done);
+  }
+  if (found.count == 0)
+    return;
+
+  StatAdd(stats, stats.candidates, found.count);
+  for (uint32_t i = 0; i < found.count; ++i)
+  {
+    JobResult &r = found.found[i];
+    r.difficulty = diff_from_target(r.hash);
+    StatMax(stats, stats.best_diff, (float)r.difficulty);
+    if (!s_job_result_ring.push(r))
+      StatAdd(stats, stats.dropped, 1);
+  }
+  if (s_stratum_task != NULL)
+    xTaskNotifyGive(s_stratum_task);
+}
+
+//Sleeps until work is published
+static void MinerIdle(MinerStats &stats)
+{
+  uint32_t idle_start = micros();
+  ulTaskNotifyTake(pdTRUE, WORK_IDLE_WAIT_MS / portTICK_PERIOD_MS);
+  StatAdd(stats, stats.idle_us, micros() - idle_start);
+}
+
+//Adds the miner counters to totalHashes, called by the monitor once per elapsed_ms
+static void MinerStatsCollect(uint32_t elapsed_ms)
+{
+  static uint32_t last_hashes[WORK_MAX_MINERS + 1];
+  static uint32_t last_busy_us[WORK_MAX_MINERS + 1];
+  static uint32_t last_idle_us[WORK_MAX_MINERS + 1];
+
+  for (int i = 0; i <= WORK_MAX_MINERS; ++i)
+  {
+    MinerStats &stats = s_miner_stats[i];
+    uint8_t engine = stats.engine.load(std::memory_order_relaxed);
+    if (engine == MINER_ENGINE_NONE)
+      continue;
+    uint32_t hashes = stats.hashes.load(std::memory_order_relaxed);
+    uint32_t busy_us = stats.busy_us.load(std::memory_order_relaxed);
+    uint32_t idle_us = stats.idle_us.load(std::memory_order_relaxed);
+    uint32_t delta = hashes - last_hashes[i];
+    totalHashes += delta;
+
+    #ifdef DEBUG_MINING
+    static const char* engine_names[] = { "", "sw", "hw", "i2c" };
+    uint32_t busy = busy_us - last_busy_us[i];
+    uint32_t idle = idle_us - last_idle_us[i];
+    Serial.printf("### Miner %d %s: %.2f KH/s, busy %u%%, candidates %u (dropped %u), best diff %.3f, stale %u hashes (abort max %u us)\n",
+                  i, engine_names[engine],
+                  elapsed_ms > 0 ? (double)delta / elapsed_ms : 0.0, busy + idle > 0 ? (uint32_t)(100ull * busy / (busy + idle)) : 0,
+                  stats.candidates.load(std::memory_order_relaxed), stats.dropped.load(std::memory_order_relaxed),
+                  stats.best_diff.load(std::memory_order_relaxed),
+                  stats.stale_hashes.load(std::memory_order_relaxed), stats.abort_max_us.load(std::memory_order_relaxed));
     #endif
+    last_hashes[i] = hashes;
+    last_busy_us[i] = busy_us;
+    last_idle_us[i] = idle_us;
+  }
+
+  Mhashes = totalHashes / 1000000;
+  uint32_t currentKHashes = totalHashes / 1000;
+  elapsedKHs = currentKHashes - totalKHashes;
+  totalKHashes = currentKHashes;
+}
+
+static void MinersWake()
+{
+  for (int i = 0; i < WORK_MAX_MINERS; ++i)
+  {
+    TaskHandle_t task = s_miner_tasks[i].load(std::memory_order_relaxed);
+    if (task != NULL)
+      xTaskNotifyGive(task);
   }
-  s_working_current_job_id = 0xFF;
-  job_pool = 0xFFFFFFFF;
-  submition_map.clear();
 }
 
 #ifdef RANDOM_NONCE
@@ -216,6 +453,429 @@ static uint32_t RandomGet()
 
 #endif
 
+//Versions mined side by side when the pool allows version rolling
+#define WORK_VERSION_SLOTS 4
+//Rolled ntime stays within the time elapsed since the notify plus this many seconds
+#define WORK_NTIME_AHEAD_S 60
+//The nonce cursor counts units of 2^WORK_UNIT_BITS nonces, claims are whole units
+#define WORK_UNIT_BITS 8
+#define WORK_SLOT_UNITS (1u << (32 - WORK_UNIT_BITS))
+//Next work is published when fewer units than this are left (~1M nonces, a few seconds of hashing)
+#define WORK_ROLL_MARGIN_UNITS 4096
+
+#ifdef RANDOM_NONCE
+//Each version slot is split in blocks of ~RANDOM_NONCE_MASK+1 nonces, claims never cross a block
+//and the cursor walks the blocks in a keyed random order, each of them once
+#define WORK_BLOCK_UNITS ((~RANDOM_NONCE_MASK + 1) >> WORK_UNIT_BITS)
+#define WORK_SLOT_BLOCKS (WORK_SLOT_UNITS / WORK_BLOCK_UNITS)
+
+//Bijection on the block indexes of a slot, odd multiplies and xorshifts are invertible mod 2^n
+static inline uint32_t WorkBlockPermute(uint32_t block, uint32_t key)
+{
+  const uint32_t mask = WORK_SLOT_BLOCKS - 1;
+  block = (block ^ key) & mask;
+  block = (block * 0x9E3779B1u) & mask;
+  block ^= block >> 9;
+  block = (block * 0x85EBCA6Bu) & mask;
+  block ^= block >> 7;
+  return (block ^ (key >> 16)) & mask;
+}
+#endif
+
+//First block midstates of one rolled version, each has its own 2^32 nonces
+struct VersionMidstate
+{
+  uint32_t version;
+  uint32_t midstate[8];
+  uint32_t bake[16];
+  uint32_t hw_midstate[8];
+};
+
+//Work of the current pool job over WORK_VERSION_SLOTS versions (BIP320). When the published work
+//runs out of nonces it rolls ntime (second block, new bakes only) while the time window allows,
+//then moves to the next versions (new midstates), and once every version of the mask is used,
+//to the next extranonce2 (new merkle root)
+struct WorkGenerator
+{
+  uint64_t extranonce2;
+  uint64_t extranonce2_mask;
+  uint32_t version;         //job version, the rolled bits are xored on top
+  uint32_t version_mask;
+  uint32_t version_index;   //rolled value of slot 0
+  uint32_t version_slots;
+  uint32_t nonce_start;
+  #ifdef RANDOM_NONCE
+  uint32_t block_key;       //order of the nonce blocks, new for every published work
+  #endif
+  #ifdef I2C_SLAVE
+  bool slaves_extranonce2;  //extranonce2 1 is hashed by the i2c slaves, never rolled onto
+  #endif
+  uint32_t ntime;           //current ntime, header word 17
+  uint32_t ntime_job;
+  uint32_t job_start;       //millis() of the notify
+  uint8_t sha_buffer[128];
+  #if defined(CONFIG_IDF_TARGET_ESP32)
+  uint8_t sha_buffer_swap[128];
+  #endif
+  VersionMidstate versions[WORK_VERSION_SLOTS];
+};
+
+//Work the miners claim nonce ranges from, slot after slot, with a compare and swap on cursor.
+//Two buffers: the stratum task writes the one not published, seq is odd while it does so
+//and miners that copied during the write drop their claim
+struct WorkDescriptor
+{
+  std::atomic<uint32_t> seq;
+  std::atomic<uint32_t> cursor;
+  uint32_t cursor_end;      //version_slots * WORK_SLOT_UNITS
+  uint32_t id;
+  uint64_t extranonce2;
+  uint32_t ntime;
+  uint32_t nonce_start;
+  #ifdef RANDOM_NONCE
+  uint32_t block_key;
+  #endif
+  double difficulty;
+  uint256 target;
+  std::atomic<uint32_t> notify_us;  //micros() of the notify until the first claim, 0 for rolled work
+  uint8_t sha_buffer[128];
+  #if defined(CONFIG_IDF_TARGET_ESP32)
+  uint8_t sha_buffer_swap[128];
+  #endif
+  VersionMidstate versions[WORK_VERSION_SLOTS];
+};
+
+static WorkDescriptor s_work_buffers[2];
+static std::atomic<WorkDescriptor*> s_work_published(NULL);
+
+static void MiningJobStop(uint32_t &job_pool, SubmitTracker &submitions)
+{
+  s_work_published.store(NULL, std::memory_order_release);
+  s_job_result_ring.clear();
+  JobGenerationSet(0xFFFFFFFF, 0xFFFFFFFF);
+  job_pool = 0xFFFFFFFF;
+  submitions.clear();
+}
+
+//Spreads the bits of index over the set bits of mask
+static uint32_t VersionBits(uint32_t index, uint32_t mask)
+{
+  uint32_t bits = 0;
+  for (uint32_t bit = 1; mask != 0 && index != 0; bit <<= 1)
+  {
+    if ((mask & bit) == 0)
+      continue;
+    if (index & 1)
+      bits |= bit;
+    index >>= 1;
+    mask &= ~bit;
+  }
+  return bits;
+}
+
+static void WorkPrepareVersions(WorkGenerator &work)
+{
+  #ifdef HARDWARE_SHA265
+  #if defined(CONFIG_IDF_TARGET_ESP32S2) || defined(CONFIG_IDF_TARGET_ESP32S3) || defined(CONFIG_IDF_TARGET_ESP32C3)
+  //Once for every slot, the hw miner may hold the engine for a whole chunk
+  esp_sha_acquire_hardware();
+  #endif
+  #endif
+  for (uint32_t i = 0; i < work.version_slots; ++i)
+  {
+    VersionMidstate &v = work.versions[i];
+    v.version = work.version ^ VersionBits(work.version_index + i, work.version_mask);
+    ((uint32_t*)work.sha_buffer)[0] = v.version;
+
+    nerd_mids(v.midstate, work.sha_buffer);
+    nerd_sha256_bake(v.midstate, work.sha_buffer+64, v.bake);
+
+    #ifdef HARDWARE_SHA265
+    #if defined(CONFIG_IDF_TARGET_ESP32S2) || defined(CONFIG_IDF_TARGET_ESP32S3) || defined(CONFIG_IDF_TARGET_ESP32C3)
+      sha_hal_hash_block(SHA2_256,  work.sha_buffer, 64/4, true);
+      sha_hal_read_digest(SHA2_256, v.hw_midstate);
+    #endif
+    #endif
+  }
+  #ifdef HARDWARE_SHA265
+  #if defined(CONFIG_IDF_TARGET_ESP32S2) || defined(CONFIG_IDF_TARGET_ESP32S3) || defined(CONFIG_IDF_TARGET_ESP32C3)
+  esp_sha_release_hardware();
+  #endif
+  #endif
+}
+
+static void WorkPrepare(WorkGenerator &work)
+{
+  coinbase_merkle_root(mCoinbase, work.extranonce2, work.sha_buffer + 36);
+
+  #if defined(CONFIG_IDF_TARGET_ESP32)
+  for (int i = 0; i < 32; ++i)
+    ((uint32_t*)work.sha_buffer_swap)[i] = __builtin_bswap32(((const uint32_t*)(work.sha_buffer))[i]);
+  #endif
+
+  work.version_index = 0;
+  WorkPrepareVersions(work);
+}
+
+//Header from calculateMiningData(), its merkle root is replaced by the one of extranonce2
+static void WorkStart(WorkGenerator &work, const uint8_t* header, uint64_t extranonce2, uint32_t version_mask, uint32_t nonce_start)
+{
+  memcpy(work.sha_buffer, header, 80);
+  memset(work.sha_buffer+80, 0, 128-80);
+  work.sha_buffer[80] = 0x80;
+  work.sha_buffer[126] = 0x02;
+  work.sha_buffer[127] = 0x80;
+
+  int bits = 8 * mCoinbase.extranonce2_size;
+  work.extranonce2_mask = bits >= 64 ? 0xFFFFFFFFFFFFFFFFull : (1ull << bits) - 1;
+  work.extranonce2 = extranonce2 & work.extranonce2_mask;
+
+  work.version = ((const uint32_t*)header)[0];
+  work.version_mask = version_mask;
+  uint32_t versions = 1u << __builtin_popcount(version_mask);  //mask is at most 16 bits
+  work.version_slots = versions < WORK_VERSION_SLOTS ? versions : WORK_VERSION_SLOTS;
+
+  work.ntime = work.ntime_job = ((const uint32_t*)header)[17];
+  work.job_start = millis();
+
+  work.nonce_start = nonce_start;
+  #ifdef RANDOM_NONCE
+  work.block_key = RandomGet();
+  #endif
+  WorkPrepare(work);
+}
+
+//ntime + 1 if the pool would still take it, the first block and its midstates stay valid
+static bool WorkRollNtime(WorkGenerator &work)
+{
+  uint32_t elapsed = (millis() - work.job_start) / 1000;
+  if (work.ntime + 1 > work.ntime_job + elapsed + WORK_NTIME_AHEAD_S)
+    return false;
+
+  work.ntime++;
+  ((uint32_t*)work.sha_buffer)[17] = work.ntime;
+  #if defined(CONFIG_IDF_TARGET_ESP32)
+  ((uint32_t*)work.sha_buffer_swap)[17] = __builtin_bswap32(work.ntime);
+  #endif
+
+  for (uint32_t i = 0; i < work.version_slots; ++i)
+  {
+    VersionMidstate &v = work.versions[i];
+    nerd_sha256_bake(v.midstate, work.sha_buffer+64, v.bake);
+  }
+  return true;
+}
+
+//Copies the generator into the buffer not published, publishes it and wakes the idle miners.
+//Miners claim from cursor on, notify_us is the micros() of a new pool job or 0
+static void WorkPublish(const WorkGenerator &work, uint32_t id, double difficulty, const uint256& target, uint32_t cursor, uint32_t notify_us)
+{
+  WorkDescriptor* d = s_work_published.load(std::memory_order_relaxed) == &s_work_buffers[0] ? &s_work_buffers[1] : &s_work_buffers[0];
+
+  uint32_t seq = d->seq.load(std::memory_order_relaxed);
+  d->seq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  d->cursor_end = work.version_slots * WORK_SLOT_UNITS;
+  d->id = id;
+  d->extranonce2 = work.extranonce2;
+  d->ntime = work.ntime;
+  d->nonce_start = work.nonce_start;
+  #ifdef RANDOM_NONCE
+  d->block_key = work.block_key;
+  #endif
+  d->difficulty = difficulty;
+  d->target = target;
+  d->notify_us.store(notify_us, std::memory_order_relaxed);
+  memcpy(d->sha_buffer, work.sha_buffer, sizeof(d->sha_buffer));
+  #if defined(CONFIG_IDF_TARGET_ESP32)
+  memcpy(d->sha_buffer_swap, work.sha_buffer_swap, sizeof(d->sha_buffer_swap));
+  #endif
+  memcpy(d->versions, work.versions, sizeof(d->versions));
+  d->cursor.store(cursor, std::memory_order_relaxed);
+
+  d->seq.store(seq + 2, std::memory_order_release);
+  s_work_published.store(d, std::memory_order_release);
+  MinersWake();
+}
+
+//Same work with a new share target, the unclaimed rest of the published cursor moves over
+static void WorkRetarget(const WorkGenerator &work, uint32_t id, double difficulty, const uint256& target)
+{
+  WorkDescriptor* d = s_work_published.load(std::memory_order_relaxed);
+  if (d == NULL)
+    return;
+  uint32_t cursor = d->cursor.exchange(d->cursor_end, std::memory_order_relaxed);
+  WorkPublish(work, id, difficulty, target, cursor < d->cursor_end ? cursor : d->cursor_end, 0);
+}
+
+//Call between pool messages, on S2/S3/C3 the new midstates need the sha hardware
+static void WorkCheckExhausted(WorkGenerator &work, uint32_t id, double difficulty, const uint256& target)
+{
+  WorkDescriptor* d = s_work_published.load(std::memory_order_relaxed);
+  if (d == NULL || d->cursor.load(std::memory_order_relaxed) + WORK_ROLL_MARGIN_UNITS < d->cursor_end)
+    return;
+
+  #ifdef RANDOM_NONCE
+  work.nonce_start = RandomGet() & RANDOM_NONCE_MASK;
+  work.block_key = RandomGet();
+  #endif
+
+  if (!WorkRollNtime(work))
+  {
+    uint32_t versions = 1u << __builtin_popcount(work.version_mask);
+    if (work.version_index + 2 * work.version_slots <= versions)
+    {
+      work.version_index += work.version_slots;
+      WorkPrepareVersions(work);
+    } else
+    {
+      work.extranonce2 = (work.extranonce2 + 1) & work.extranonce2_mask;
+      #ifdef I2C_SLAVE
+      if (work.slaves_extranonce2 && work.extranonce2 == 1)
+        work.extranonce2 = 2;
+      #endif
+      WorkPrepare(work);
+      Serial.printf("Nonce space used, next extranonce2 %08x%08x\n", (uint32_t)(work.extranonce2 >> 32), (uint32_t)work.extranonce2);
+    }
+  }
+  WorkPublish(work, id, difficulty, target, 0, 0);
+}
+
+//Chunks are sized to take about this long on the worker that claims them
+#define WORK_CHUNK_TARGET_US 50000
+#define WORK_CHUNK_MIN_NONCES 256
+#define WORK_CHUNK_MAX_NONCES (1u << 20)
+//Time between stale job checks, bounds the hashing of a range after its job went stale.
+//Never more often than every WORK_CHUNK_MIN_ABORT nonces
+#ifndef WORK_ABORT_CHECK_US
+#define WORK_ABORT_CHECK_US 1000
+#endif
+#define WORK_CHUNK_MIN_ABORT 16
+
+//Per worker chunk size, a power of two between WORK_CHUNK_MIN_NONCES and WORK_CHUNK_MAX_NONCES
+struct ChunkTuner
+{
+  uint32_t nonces;
+  uint32_t abort_mask;  //check the job generation when (n & abort_mask) == 0
+};
+
+//nonces is what the worker hashes in WORK_CHUNK_TARGET_US
+static void ChunkTunerSet(ChunkTuner &tuner, uint32_t nonces)
+{
+  uint32_t interval = (uint32_t)((uint64_t)nonces * WORK_ABORT_CHECK_US / WORK_CHUNK_TARGET_US);
+  if (interval < WORK_CHUNK_MIN_ABORT)
+    interval = WORK_CHUNK_MIN_ABORT;
+  tuner.abort_mask = (1u << (31 - __builtin_clz(interval))) - 1;
+
+  if (nonces < WORK_CHUNK_MIN_NONCES)
+    nonces = WORK_CHUNK_MIN_NONCES;
+  if (nonces > WORK_CHUNK_MAX_NONCES)
+    nonces = WORK_CHUNK_MAX_NONCES;
+  tuner.nonces = 1u << (31 - __builtin_clz(nonces));
+}
+
+//Next chunk from the nonces the last one hashed and the time it took
+static void ChunkTunerUpdate(ChunkTuner &tuner, uint32_t nonces_done, uint32_t elapsed_us)
+{
+  if (elapsed_us < 1000)
+    return;  //too short to measure, the next full chunk will tell
+  ChunkTunerSet(tuner, (uint32_t)((uint64_t)nonces_done * WORK_CHUNK_TARGET_US / elapsed_us));
+}
+
+//Boot benchmark, set by minerSchedule() before the miners start
+static miner_plan s_miner_plan;
+
+//First claim of a miner, WORK_CHUNK_TARGET_US of hashing at the rate benchmarked on its core
+static uint32_t MinerPlanNonces(uint32_t miner_id, uint32_t fallback)
+{
+  uint32_t rate = miner_id < MINER_PLAN_MAX ? s_miner_plan.rate[miner_id] : 0;
+  if (rate == 0)
+    return fallback;
+  return (uint32_t)((uint64_t)rate * WORK_CHUNK_TARGET_US / 1000000);
+}
+
+//Claims the next nonce_count nonces (less at the end of a version slot) of the published work
+static bool WorkClaim(JobRequest &job, uint32_t nonce_count, bool hw)
+{
+  WorkDescriptor* d = s_work_published.load(std::memory_order_acquire);
+  if (d == NULL)
+    return false;
+  uint32_t seq = d->seq.load(std::memory_order_acquire);
+  if ((seq & 1) != 0 || d->cursor.load(std::memory_order_relaxed) >= d->cursor_end)
+    return false;
+
+  //Clipped to the version slot, and to the block with RANDOM_NONCE, before taking it, the rest
+  //goes to the next claim. Work rewritten meanwhile isn't taken from. A rewrite between the check
+  //and the swap only loses units if it left the cursor on the same value, the seq check below drops them
+  uint32_t wanted = nonce_count >> WORK_UNIT_BITS;
+  uint32_t units;
+  uint32_t at = d->cursor.load(std::memory_order_relaxed);
+  do
+  {
+    if (at >= d->cursor_end)
+      return false;
+    uint32_t left = WORK_SLOT_UNITS - at % WORK_SLOT_UNITS;
+    #ifdef RANDOM_NONCE
+    uint32_t block_left = WORK_BLOCK_UNITS - at % WORK_BLOCK_UNITS;
+    if (block_left < left)
+      left = block_left;
+    #endif
+    units = wanted < left ? wanted : left;
+    if (d->seq.load(std::memory_order_acquire) != seq || s_work_published.load(std::memory_order_relaxed) != d)
+      return false;
+  } while (!d->cursor.compare_exchange_weak(at, at + units, std::memory_order_relaxed));
+  uint32_t slot = at / WORK_SLOT_UNITS;
+
+  const VersionMidstate &v = d->versions[slot];
+  job.id = d->id;
+  job.extranonce2 = d->extranonce2;
+  job.version = v.version;
+  job.ntime = d->ntime;
+  uint32_t offset = at % WORK_SLOT_UNITS;
+  #ifdef RANDOM_NONCE
+  offset = WorkBlockPermute(offset / WORK_BLOCK_UNITS, d->block_key) * WORK_BLOCK_UNITS + offset % WORK_BLOCK_UNITS;
+  #endif
+  job.nonce_start = d->nonce_start + (offset << WORK_UNIT_BITS);
+  job.nonce_count = units << WORK_UNIT_BITS;
+  job.difficulty = d->difficulty;
+  job.target = d->target;
+  memcpy(job.bake, v.bake, sizeof(job.bake));
+  if (!hw)
+  {
+    memcpy(job.sha_buffer, d->sha_buffer, sizeof(job.sha_buffer));
+    memcpy(job.midstate, v.midstate, sizeof(job.midstate));
+    ((uint32_t*)job.sha_buffer)[0] = v.version;
+  } else
+  {
+  #if defined(CONFIG_IDF_TARGET_ESP32)
+    memcpy(job.sha_buffer, d->sha_buffer_swap, sizeof(job.sha_buffer));
+    ((uint32_t*)job.sha_buffer)[0] = __builtin_bswap32(v.version);
+  #else
+    memcpy(job.sha_buffer, d->sha_buffer, sizeof(job.sha_buffer));
+    ((uint32_t*)job.sha_buffer)[0] = v.version;
+  #endif
+    memcpy(job.midstate, v.hw_midstate, sizeof(job.midstate));
+  }
+
+  //Rewritten while copying, the units claimed are skipped
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (d->seq.load(std::memory_order_relaxed) != seq)
+    return false;
+
+  if (d->notify_us.load(std::memory_order_relaxed) != 0)
+  {
+    uint32_t notify_us = d->notify_us.exchange(0, std::memory_order_relaxed);
+    if (notify_us != 0)
+    {
+      jobSwitchLatency_us = micros() - notify_us;
+      if (jobSwitchLatency_us > jobSwitchLatencyMax_us)
+        jobSwitchLatencyMax_us = jobSwitchLatency_us;
+    }
+  }
+  return true;
+}
+
 void runStratumWorker(void *name) {
 
 // TEST: https://bitcoin.stackexchange.com/questions/22929/full-example-data-for-scrypt-stratum-client
@@ -227,10 +887,18 @@ void runStratumWorker(void *name) {
   Serial.printf("### [Total Heap / Free heap / Min free heap]: %d / %d / %d \n", ESP.getHeapSize(), ESP.getFreeHeap(), ESP.getMinFreeHeap());
   #endif
 
-  std::map<uint32_t, std::shared_ptr<Submition>> s_submition_map;
+  s_stratum_task = xTaskGetCurrentTaskHandle();
+  #ifdef RANDOM_NONCE
+  //Hardware rng seed, a fixed one would give every miner of a fleet the same block order
+  s_random_state = ((uint64_t)esp_random() << 32) | esp_random();
+  #endif
+  static SubmitTracker s_submitions(submitStats);
 
 #ifdef I2C_SLAVE
   std::vector<uint8_t> i2c_slave_vector;
+  //Slaves get the header of extranonce2 1, local workers start from extranonce2 2
+  uint32_t i2c_midstate[8];
+  uint32_t i2c_bake[16];
 
   //scan for i2c slaves
   if (i2c_master_start() == 0)
@@ -238,6 +906,7 @@ void runStratumWorker(void *name) {
   Serial.printf("Found %d slave workers\n", i2c_slave_vector.size());
   if (!i2c_slave_vector.empty())
   {
+    s_miner_stats[MINER_STATS_I2C].engine.store(MINER_ENGINE_I2C, std::memory_order_relaxed);
     Serial.print("  Workers: ");
     for (size_t n = 0; n < i2c_slave_vector.size(); ++n)
       Serial.printf("0x%02X,", (uint32_t)i2c_slave_vector[n]);
@@ -247,8 +916,23 @@ void runStratumWorker(void *name) {
 
   // connect to pool  
   double currentPoolDifficulty = DEFAULT_DIFFICULTY;
-  uint32_t nonce_pool = 0;
+  //Integer targets so workers only do float math on hashes that beat the share target
+  uint256 share_target;
+  uint256 block_target;
+  uint256_from_diff(currentPoolDifficulty, &share_target);
+  uint256_from_nbits(0x1d00ffff, &block_target);
+  static WorkGenerator work;
+  //Jobs rotate instead of being copied: a notify is decoded into the spare one, which then
+  //becomes the current job, the current one the previous and the previous one the spare
+  static mining_job s_jobs[3];
+  mining_job* job = &s_jobs[0];
+  mining_job* prev_job = &s_jobs[1];
+  mining_job* spare_job = &s_jobs[2];
+  //mining.submit template of each job, shares only patch their fields in
+  static stratum_submit s_submits[3];
   uint32_t job_pool = 0xFFFFFFFF;
+  //Job replaced by a notify with clean_jobs false, shares of its ranges in flight are still submitted
+  uint32_t prev_job_pool = 0xFFFFFFFF;
   uint32_t last_job_time = millis();
 
   while(true) {
@@ -256,7 +940,7 @@ void runStratumWorker(void *name) {
     if(WiFi.status() != WL_CONNECTED){
       // WiFi is disconnected, so reconnect now
       mMonitor.NerdStatus = NM_Connecting;
-      MiningJobStop(job_pool, s_submition_map);
+      MiningJobStop(job_pool, s_submitions);
       WiFi.reconnect();
       vTaskDelay(5000 / portTICK_PERIOD_MS);
       continue;
@@ -265,7 +949,7 @@ void runStratumWorker(void *name) {
     if(!checkPoolConnection()){
       //If server is not reachable add random delay for connection retries
       //Generate value between 1 and 60 secs
-      MiningJobStop(job_pool, s_submition_map);
+      MiningJobStop(job_pool, s_submitions);
       vTaskDelay(((1 + rand() % 60) * 1000) / portTICK_PERIOD_MS);
       continue;
     }
@@ -275,13 +959,17 @@ void runStratumWorker(void *name) {
       //Stop miner current jobs
       mWorker = init_mining_subscribe();
 
+      // STEP 0: Version rolling (CONFIGURE), mine without it if the pool refuses
+      tx_mining_configure(client, mWorker);
+
       // STEP 1: Pool server connection (SUBSCRIBE)
       if(!tx_mining_subscribe(client, mWorker)) { 
         client.stop();
-        MiningJobStop(job_pool, s_submition_map);
+        MiningJobStop(job_pool, s_submitions);
         continue; 
       }
       
+      static_assert(sizeof(Settings.BtcWallet) <= sizeof(mWorker.wName), "the wallet is the worker name of the submit template");
       strcpy(mWorker.wName, Settings.BtcWallet);
       strcpy(mWorker.wPass, Settings.PoolPassword);
       // STEP 2: Pool authorize work (Block Info)
@@ -303,7 +991,7 @@ void runStratumWorker(void *name) {
       Serial.println("  Detected more than 2 min without data form stratum server. Closing socket and reopening...");
       client.stop();
       isMinerSuscribed=false;
-      MiningJobStop(job_pool, s_submition_map);
+      MiningJobStop(job_pool, s_submitions);
       continue; 
     }
 
@@ -315,150 +1003,120 @@ void runStratumWorker(void *name) {
       {
         client.stop();
         isMinerSuscribed=false;
-        MiningJobStop(job_pool, s_submition_map);
+        MiningJobStop(job_pool, s_submitions);
         continue;
       }
     }
 
-    uint32_t hw_midstate[8];
-    uint32_t diget_mid[8];
-    uint32_t bake[16];
-    #if defined(CONFIG_IDF_TARGET_ESP32)
-    uint8_t sha_buffer_swap[128];
-    #endif
-
     //Read pending messages from pool
-    while(client.connected() && client.available())
+    const char* line;
+    uint32_t line_len;
+    while(client.connected() && PoolLineNext(line, line_len))
     {
-      String line = client.readStringUntil('\n');
       //Serial.println("  Received message from pool");      
-      stratum_method result = parse_mining_method(line);
+      stratum_method result = parse_mining_method(line, line_len, *spare_job);
       switch (result)
       {
-          case MINING_NOTIFY:         if(parse_mining_notify(line, mJob))
-                                      {
-                                          {
-                                            std::lock_guard<std::mutex> lock(s_job_mutex);
-                                            s_job_request_list_sw.clear();
-                                            #ifdef HARDWARE_SHA265
-                                            s_job_request_list_hw.clear();
-                                            #endif
-                                          }
+          case MINING_NOTIFY:         {
+                                          mining_job* retired = prev_job;
+                                          prev_job = job;
+                                          job = spare_job;
+                                          spare_job = retired;
+
+                                          uint32_t notify_us = micros() | 1;  //0 means rolled work
                                           //Increse templates readed
                                           templates++;
+                                          prev_job_pool = (job->clean_jobs || job_pool == 0xFFFFFFFF) ? 0xFFFFFFFF : job_pool;
                                           job_pool++;
-                                          s_working_current_job_id = job_pool & 0xFF; //Terminate current job in thread
 
                                           last_job_time = millis();
                                           mLastTXtoPool = last_job_time;
 
-                                          uint32_t mh = hashes/1000000;
-                                          Mhashes += mh;
-                                          hashes -= mh*1000000;
+                                          //Prepare data for new jobs, miners keep hashing the published work meanwhile
+                                          mMiner=calculateMiningData(mWorker, *job, mCoinbase);
+                                          uint256_from_nbits(job->nbits, &block_target);
 
-                                          //Prepare data for new jobs
-                                          mMiner=calculateMiningData(mWorker, mJob);
+                                          uint64_t extranonce2 = 1;
+                                          uint32_t nonce_pool;
+                                          #ifdef RANDOM_NONCE
+                                          nonce_pool = RandomGet() & RANDOM_NONCE_MASK;
+                                          #else
+                                          nonce_pool = 0xDA54E700;  //nonce 0x00000000 is not possible, start from some random nonce
+                                          #endif
 
+                                          #ifdef I2C_SLAVE
                                           memset(mMiner.bytearray_blockheader+80, 0, 128-80);
                                           mMiner.bytearray_blockheader[80] = 0x80;
                                           mMiner.bytearray_blockheader[126] = 0x02;
                                           mMiner.bytearray_blockheader[127] = 0x80;
-
-                                          nerd_mids(diget_mid, mMiner.bytearray_blockheader);
-                                          nerd_sha256_bake(diget_mid, mMiner.bytearray_blockheader+64, bake);
-
-                                          #ifdef HARDWARE_SHA265
-                                          #if defined(CONFIG_IDF_TARGET_ESP32S2) || defined(CONFIG_IDF_TARGET_ESP32S3) || defined(CONFIG_IDF_TARGET_ESP32C3)
-                                            esp_sha_acquire_hardware();
-                                            sha_hal_hash_block(SHA2_256,  mMiner.bytearray_blockheader, 64/4, true);
-                                            sha_hal_read_digest(SHA2_256, hw_midstate);
-                                            esp_sha_release_hardware();
-                                          #endif
-                                          #endif
-
-                                          #if defined(CONFIG_IDF_TARGET_ESP32)
-                                          for (int i = 0; i < 32; ++i)
-                                            ((uint32_t*)sha_buffer_swap)[i] = __builtin_bswap32(((const uint32_t*)(mMiner.bytearray_blockheader))[i]);
+                                          nerd_mids(i2c_midstate, mMiner.bytearray_blockheader);
+                                          nerd_sha256_bake(i2c_midstate, mMiner.bytearray_blockheader+64, i2c_bake);
+                                          if (!i2c_slave_vector.empty())
+                                            extranonce2 = 2;
+                                          work.slaves_extranonce2 = !i2c_slave_vector.empty();
                                           #endif
 
-                                          #ifdef RANDOM_NONCE
-                                          nonce_pool = RandomGet() & RANDOM_NONCE_MASK;
-                                          #else
-                                            #ifdef I2C_SLAVE
-                                            if (!i2c_slave_vector.empty())
-                                              nonce_pool = 0x10000000;
-                                            else
-                                            #endif
-                                              nonce_pool = 0xDA54E700;  //nonce 0x00000000 is not possible, start from some random nonce
-                                          #endif
-                                          
-
-                                          {
-                                            std::lock_guard<std::mutex> lock(s_job_mutex);
-                                            for (int i = 0; i < 4; ++ i)
-                                            {
-                                              #if 1
-                                              JobPush( s_job_request_list_sw, job_pool, nonce_pool, NONCE_PER_JOB_SW, currentPoolDifficulty, mMiner.bytearray_blockheader, diget_mid, bake);
-                                              #ifdef RANDOM_NONCE
-                                              nonce_pool = RandomGet() & RANDOM_NONCE_MASK;
-                                              #else
-                                              nonce_pool += NONCE_PER_JOB_SW;
-                                              #endif
-                                              #endif
-                                              #ifdef HARDWARE_SHA265
-                                                #if defined(CONFIG_IDF_TARGET_ESP32)
-                                                  JobPush( s_job_request_list_hw, job_pool, nonce_pool, NONCE_PER_JOB_HW, currentPoolDifficulty, sha_buffer_swap, hw_midstate, bake);
-                                                #else
-                                                  JobPush( s_job_request_list_hw, job_pool, nonce_pool, NONCE_PER_JOB_HW, currentPoolDifficulty, mMiner.bytearray_blockheader, hw_midstate, bake);
-                                                #endif
-                                              #ifdef RANDOM_NONCE
-                                              nonce_pool = RandomGet() & RANDOM_NONCE_MASK;
-                                              #else
-                                              nonce_pool += NONCE_PER_JOB_HW;
-                                              #endif
-                                              #endif
-                                            }
-                                          }
+                                          job->version_mask = mWorker.version_mask;
+                                          WorkStart(work, mMiner.bytearray_blockheader, extranonce2, job->version_mask, nonce_pool);
+                                          //Terminate current job in thread, unless the pool still takes its shares. Set before
+                                          //the publish wakes the miners, else a range of the new work would look stale
+                                          JobGenerationSet(job_pool, prev_job_pool != 0xFFFFFFFF ? prev_job_pool : job_pool);
+                                          WorkPublish(work, job_pool, currentPoolDifficulty, share_target, 0, notify_us);
                                           #ifdef I2C_SLAVE
-                                          //Nonce for nonce_pool starts from 0x10000000
                                           //For i2c slave we give nonces from 0x20000000, that is 0x10000000 nonces per slave
+                                          //of extranonce2 1, local workers are on their own extranonce2 so ranges never overlap
                                           i2c_feed_slaves(i2c_slave_vector, job_pool & 0xFF, 0x20, currentPoolDifficulty, mMiner.bytearray_blockheader);
                                           #endif
-                                      } else
-                                      {
+
+                                          if (!stratum_submit_init(s_submits[job - s_jobs], mWorker.wName, job->job_id, mCoinbase.extranonce2_size, job->version_mask != 0))
+                                            Serial.println("Submit template doesn't fit, shares of this job are not sent");
+                                      }
+                                      break;
+          case MINING_NOTIFY_ERROR:   {
                                         Serial.println("Parsing error, need restart");
                                         client.stop();
                                         isMinerSuscribed=false;
-                                        MiningJobStop(job_pool, s_submition_map);
+                                        MiningJobStop(job_pool, s_submitions);
                                       }
                                       break;
-          case MINING_SET_DIFFICULTY: parse_mining_set_difficulty(line, currentPoolDifficulty);
+          case MINING_SET_DIFFICULTY: parse_mining_set_difficulty(line, line_len, currentPoolDifficulty);
+                                      uint256_from_diff(currentPoolDifficulty, &share_target);
+                                      WorkRetarget(work, job_pool, currentPoolDifficulty, share_target);
+                                      break;
+          case MINING_SET_VERSION_MASK: //Applies from the next job
+                                      parse_mining_set_version_mask(line, line_len, mWorker.version_mask);
                                       break;
-          case STRATUM_SUCCESS:       {
-                                        unsigned long id = parse_extract_id(line);
-                                        auto itt = s_submition_map.find(id);
-                                        if (itt != s_submition_map.end())
+          case STRATUM_SUCCESS:
+          case STRATUM_PARSE_ERROR:
+          case STRATUM_UNKNOWN:       {
+                                        //Answers to our submits, matched by id
+                                        stratum_response response;
+                                        Submition submition;
+                                        if (!parse_submit_response(line, line_len, response))
                                         {
-                                          if (itt->second->diff > best_diff)
-                                            best_diff = itt->second->diff;
-                                          if (itt->second->is32bit)
-                                            shares++;
-                                          if (itt->second->isValid)
-                                          {
-                                            Serial.println("CONGRATULATIONS! Valid block found");
-                                            valids++;
-                                          }
-                                          s_submition_map.erase(itt);
+                                          if (result == STRATUM_UNKNOWN)
+                                            Serial.println("  Parsed JSON: unknown");
+                                          break;
                                         }
-                                      }
-                                      break;
-          case STRATUM_PARSE_ERROR:   {
-                                        unsigned long id = parse_extract_id(line);
-                                        auto itt = s_submition_map.find(id);
-                                        if (itt != s_submition_map.end())
+                                        if (parse_mining_configure_answer(line, line_len, response.id, mWorker))
+                                          break;
+                                        submit_outcome outcome = response.accepted ? SUBMIT_ACCEPTED : response.stale ? SUBMIT_STALE : SUBMIT_REJECTED;
+                                        if (!s_submitions.answered(response.id, micros(), outcome, submition))
+                                          break;
+                                        if (outcome != SUBMIT_ACCEPTED)
+                                        {
+                                          Serial.printf("Refuse submition %u%s: %d %s\n", submition.id, outcome == SUBMIT_STALE ? " (stale)" : "",
+                                                        response.error_code, response.reason);
+                                          break;
+                                        }
+                                        if (submition.diff > best_diff)
+                                          best_diff = submition.diff;
+                                        if (submition.is32bit)
+                                          shares++;
+                                        if (submition.isValid)
                                         {
-                                          Serial.printf("Refuse submition %d\n", id);
-                                          s_submition_map.erase(itt);
+                                          Serial.println("CONGRATULATIONS! Valid block found");
+                                          valids++;
                                         }
                                       }
                                       break;
@@ -467,11 +1125,10 @@ void runStratumWorker(void *name) {
       }
     }
 
-    std::list<std::shared_ptr<JobResult>> job_result_list;
     #ifdef I2C_SLAVE
     if (i2c_slave_vector.empty() || job_pool == 0xFFFFFFFF)
     {
-      vTaskDelay(50 / portTICK_PERIOD_MS); //Small delay
+      ulTaskNotifyTake(pdTRUE, 50 / portTICK_PERIOD_MS); //Small delay, a result ends it early
     } else
     {
       uint32_t time_start = millis();
@@ -479,18 +1136,21 @@ void runStratumWorker(void *name) {
       vTaskDelay(5 / portTICK_PERIOD_MS);
       uint32_t nonces_done = 0;
       std::vector<uint32_t> nonce_vector = i2c_harvest_slaves(i2c_slave_vector, job_pool & 0xFF, nonces_done);
-      hashes += nonces_done;
+      StatAdd(s_miner_stats[MINER_STATS_I2C], s_miner_stats[MINER_STATS_I2C].hashes, nonces_done);
+      JobResult i2c_result;
+      JobResult* result = &i2c_result;
       for (size_t n = 0; n < nonce_vector.size(); ++n)
       {
-        std::shared_ptr<JobResult> result = std::make_shared<JobResult>();
         ((uint32_t*)(mMiner.bytearray_blockheader+64+12))[0] = nonce_vector[n];
-        if (nerd_sha256d_baked(diget_mid, mMiner.bytearray_blockheader+64, bake, result->hash))
+        if (nerd_sha256d_baked(i2c_midstate, mMiner.bytearray_blockheader+64, i2c_bake, result->hash))
         {
           result->id = job_pool;
+          result->extranonce2 = 1;
+          result->version = ((const uint32_t*)mMiner.bytearray_blockheader)[0];
+          result->ntime = ((const uint32_t*)mMiner.bytearray_blockheader)[17];
           result->nonce = nonce_vector[n];
-          result->nonce_count = 0;
           result->difficulty = diff_from_target(result->hash);
-          job_result_list.push_back(result);
+          s_job_result_ring.push(*result);
         }
       }
       uint32_t time_end = millis();
@@ -505,57 +1165,27 @@ void runStratumWorker(void *name) {
         vTaskDelay(40 / portTICK_PERIOD_MS);
     }
     #else
-    vTaskDelay(50 / portTICK_PERIOD_MS); //Small delay
+    ulTaskNotifyTake(pdTRUE, 50 / portTICK_PERIOD_MS); //Small delay, a result ends it early
     #endif
 
     
     if (job_pool != 0xFFFFFFFF)
-    {
-      std::lock_guard<std::mutex> lock(s_job_mutex);
-      job_result_list.insert(job_result_list.end(), s_job_result_list.begin(), s_job_result_list.end());
-      s_job_result_list.clear();
-
-#if 1
-      while (s_job_request_list_sw.size() < 4)
-      {
-        JobPush( s_job_request_list_sw, job_pool, nonce_pool, NONCE_PER_JOB_SW, currentPoolDifficulty, mMiner.bytearray_blockheader, diget_mid, bake);
-        #ifdef RANDOM_NONCE
-        nonce_pool = RandomGet() & RANDOM_NONCE_MASK;
-        #else
-        nonce_pool += NONCE_PER_JOB_SW;
-        #endif
-      }
-#endif
-
-      #ifdef HARDWARE_SHA265
-      while (s_job_request_list_hw.size() < 4)
-      {
-        #if defined(CONFIG_IDF_TARGET_ESP32)
-          JobPush( s_job_request_list_hw, job_pool, nonce_pool, NONCE_PER_JOB_HW, currentPoolDifficulty, sha_buffer_swap, hw_midstate, bake);
-        #else
-          JobPush( s_job_request_list_hw, job_pool, nonce_pool, NONCE_PER_JOB_HW, currentPoolDifficulty, mMiner.bytearray_blockheader, hw_midstate, bake);
-        #endif
-        #ifdef RANDOM_NONCE
-        nonce_pool = RandomGet() & RANDOM_NONCE_MASK;
-        #else
-        nonce_pool += NONCE_PER_JOB_HW;
-        #endif
-      }
-      #endif
-    }
+      WorkCheckExhausted(work, job_pool, currentPoolDifficulty, share_target);
 
-    while (!job_result_list.empty())
+    JobResult result_data;
+    JobResult* res = &result_data;
+    while (job_pool != 0xFFFFFFFF && s_job_result_ring.pop(result_data))
     {
-      std::shared_ptr<JobResult> res = job_result_list.front();
-      job_result_list.pop_front();
-
-      hashes += res->nonce_count;
-      if (res->difficulty > currentPoolDifficulty && job_pool == res->id && res->nonce != 0xFFFFFFFF)
+      bool previous = prev_job_pool != 0xFFFFFFFF && prev_job_pool == res->id;
+      if (res->difficulty > currentPoolDifficulty && (job_pool == res->id || previous))
       {
         if (!client.connected())
           break;
         unsigned long sumbit_id = 0;
-        tx_mining_submit(client, mWorker, mJob, res->nonce, sumbit_id);
+        mining_job* share_job = previous ? prev_job : job;
+        if (!tx_mining_submit(client, s_submits[share_job - s_jobs], res->extranonce2, res->ntime, res->nonce, res->version ^ share_job->version, sumbit_id))
+          continue;
+        uint32_t sent_us = micros();
         Serial.print("   - Current diff share: "); Serial.println(res->difficulty,12);
         Serial.print("   - Current pool diff : "); Serial.println(currentPoolDifficulty,12);
         Serial.print("   - TX SHARE: ");
@@ -564,18 +1194,18 @@ void runStratumWorker(void *name) {
         Serial.println("");
         mLastTXtoPool = millis();
 
-        std::shared_ptr<Submition> submition = std::make_shared<Submition>();
-        submition->diff = res->difficulty;
-        submition->is32bit = (res->hash[29] == 0 && res->hash[28] == 0);
-        if (submition->is32bit)
+        Submition submition;
+        submition.id = sumbit_id;
+        submition.sent_us = sent_us;
+        submition.diff = res->difficulty;
+        submition.is32bit = (res->hash[29] == 0 && res->hash[28] == 0);
+        if (submition.is32bit)
         {
-          submition->isValid = checkValid(res->hash, mMiner.bytearray_target);
+          submition.isValid = uint256_hash_below(res->hash, &block_target);
         } else
-          submition->isValid = false;
+          submition.isValid = false;
 
-        s_submition_map.insert(std::make_pair(sumbit_id, submition));
-        if (s_submition_map.size() > 32)
-          s_submition_map.erase(s_submition_map.begin());
+        s_submitions.sent(submition);
       }
     }
   }
@@ -583,62 +1213,69 @@ void runStratumWorker(void *name) {
 
 //////////////////THREAD CALLS///////////////////
 
+//Hashes a claimed range into found, stops early when the job goes stale. Returns the nonces done
+static uint32_t MinerHashSw(JobRequest* job, Candidates &found, uint32_t abort_mask)
+{
+  CandidatesStart(found, job);
+#ifdef NERD_SHA256_X2
+  //Two nonces per call, nonce_count is always even. Opt in per board, once the x2 benchmark
+  //of test_performance_benchmark.cpp beats nerd_sha256d_baked() on it
+  uint8_t hash[64];
+  for (uint32_t n = 0; n < job->nonce_count; n += 2)
+  {
+    ((uint32_t*)(job->sha_buffer+64+12))[0] = job->nonce_start+n;
+    uint32_t mask = nerd_sha256d_baked_x2(job->midstate, job->sha_buffer+64, job->bake, hash);
+    for (uint32_t l = 0; mask != 0; ++l, mask >>= 1)
+    {
+      if ((mask & 1) == 0)
+        continue;
+      if (uint256_hash_below(hash + 32*l, &found.threshold))
+        CandidatesAdd(found, job, job->nonce_start+n+l, hash + 32*l);
+    }
+
+    if ( (n & abort_mask) == 0 && JobStale(job->id))
+      return n+2;
+  }
+#else
+  uint8_t hash[32];
+  for (uint32_t n = 0; n < job->nonce_count; n++)
+  {
+    ((uint32_t*)(job->sha_buffer+64+12))[0] = job->nonce_start+n;
+    if (nerd_sha256d_baked(job->midstate, job->sha_buffer+64, job->bake, hash) &&
+        uint256_hash_below(hash, &found.threshold))
+      CandidatesAdd(found, job, job->nonce_start+n, hash);
+
+    if ( (n & abort_mask) == 0 && JobStale(job->id))
+      return n+1;
+  }
+#endif
+  return job->nonce_count;
+}
+
 void minerWorkerSw(void * task_id)
 {
   unsigned int miner_id = (uint32_t)task_id;
   Serial.printf("[MINER] %d Started minerWorkerSw Task!\n", miner_id);
+  MinerStats &stats = MinerRegister(MINER_ENGINE_SW);
 
-  std::shared_ptr<JobRequest> job;
-  std::shared_ptr<JobResult> result;
-  uint8_t hash[32];
+  JobRequest &job_data = MinerBuffer(s_miner_jobs, stats);
+  Candidates &found = MinerBuffer(s_miner_found, stats);
+  JobRequest* job = NULL;
   uint32_t wdt_counter = 0;
+  ChunkTuner tuner;
+  ChunkTunerSet(tuner, MinerPlanNonces(miner_id, NONCE_PER_JOB_SW));
   while (1)
   {
-    {
-      std::lock_guard<std::mutex> lock(s_job_mutex);
-      if (result)
-      {
-        if (s_job_result_list.size() < 16)
-          s_job_result_list.push_back(result);
-        result.reset();
-      }
-      if (!s_job_request_list_sw.empty())
-      {
-        job = s_job_request_list_sw.front();
-        s_job_request_list_sw.pop_front();
-      } else
-        job.reset();
-    }
+    job = WorkClaim(job_data, tuner.nonces, false) ? &job_data : NULL;
     if (job)
     {
-      result = std::make_shared<JobResult>();
-      result->difficulty = job->difficulty;
-      result->nonce = 0xFFFFFFFF;
-      result->id = job->id;
-      result->nonce_count = job->nonce_count;
-      uint8_t job_in_work = job->id & 0xFF;
-      for (uint32_t n = 0; n < job->nonce_count; ++n)
-      {
-        ((uint32_t*)(job->sha_buffer+64+12))[0] = job->nonce_start+n;
-        if (nerd_sha256d_baked(job->midstate, job->sha_buffer+64, job->bake, hash))
-        {
-          double diff_hash = diff_from_target(hash);
-          if (diff_hash > result->difficulty)
-          {
-            result->difficulty = diff_hash;
-            result->nonce = job->nonce_start+n;
-            memcpy(result->hash, hash, 32);
-          }
-        }
-
-        if ( (uint16_t)(n & 0xFF) == 0 &&s_working_current_job_id != job_in_work)
-        {
-          result->nonce_count = n+1;
-          break;
-        }
-      }
+      uint32_t time_start = micros();
+      uint32_t nonces_done = MinerHashSw(job, found, tuner.abort_mask);
+      uint32_t busy_us = micros() - time_start;
+      ChunkTunerUpdate(tuner, nonces_done, busy_us);
+      MinerChunkDone(stats, job, found, nonces_done, busy_us);
     } else
-      vTaskDelay(2 / portTICK_PERIOD_MS);
+      MinerIdle(stats);
 
     wdt_counter++;
     if (wdt_counter >= 8)
@@ -779,115 +1416,103 @@ static inline void nerd_sha_hal_wait_idle()
 }
 
 //#define VALIDATION
-void minerWorkerHw(void * task_id)
+//Hashes a claimed range into found with the sha engine, stops early when the job goes stale. Returns the nonces done
+static uint32_t MinerHashHw(JobRequest* job, Candidates &found, uint32_t abort_mask)
 {
-  unsigned int miner_id = (uint32_t)task_id;
-  Serial.printf("[MINER] %d Started minerWorkerHw Task!\n", miner_id);
-
-  std::shared_ptr<JobRequest> job;
-  std::shared_ptr<JobResult> result;
-  uint8_t interResult[64];
   uint8_t hash[32];
   uint8_t digest_mid[32];
   uint8_t sha_buffer[64];
-  uint32_t wdt_counter = 0;
-
 #ifdef VALIDATION
   uint8_t doubleHash[32];
   uint32_t diget_mid[8];
   uint32_t bake[16];
 #endif
 
-  while (1)
-  {
-    {
-      std::lock_guard<std::mutex> lock(s_job_mutex);
-      if (result)
-      {
-        if (s_job_result_list.size() < 16)
-          s_job_result_list.push_back(result);
-        result.reset();
-      }
-      if (!s_job_request_list_hw.empty())
-      {
-        job = s_job_request_list_hw.front();
-        s_job_request_list_hw.pop_front();
-      } else
-        job.reset();
-    }
-    if (job)
-    {
-      result = std::make_shared<JobResult>();
-      result->id = job->id;
-      result->nonce = 0xFFFFFFFF;
-      result->nonce_count = job->nonce_count;
-      result->difficulty = job->difficulty;
-      uint8_t job_in_work = job->id & 0xFF;
-      memcpy(digest_mid, job->midstate, sizeof(digest_mid));
-      memcpy(sha_buffer, job->sha_buffer+64, sizeof(sha_buffer));
+  CandidatesStart(found, job);
+  memcpy(digest_mid, job->midstate, sizeof(digest_mid));
+  memcpy(sha_buffer, job->sha_buffer+64, sizeof(sha_buffer));
 #ifdef VALIDATION
-      nerd_mids(diget_mid, job->sha_buffer);
-      nerd_sha256_bake(diget_mid, job->sha_buffer+64, bake);
+  nerd_mids(diget_mid, job->sha_buffer);
+  nerd_sha256_bake(diget_mid, job->sha_buffer+64, bake);
 #endif
 
-      esp_sha_acquire_hardware();
-      REG_WRITE(SHA_MODE_REG, SHA2_256);
-      uint32_t nend = job->nonce_start + job->nonce_count;
-      for (uint32_t n = job->nonce_start; n < nend; ++n)
-      {
-        //nerd_sha_hal_wait_idle();
-        nerd_sha_ll_write_digest(digest_mid);
-        //nerd_sha_hal_wait_idle();
-        nerd_sha_ll_fill_text_block_sha256(sha_buffer, n);
-        //sha_ll_continue_block(SHA2_256);
-        REG_WRITE(SHA_CONTINUE_REG, 1);
-        
-        sha_ll_load(SHA2_256);
-        nerd_sha_hal_wait_idle();
-        nerd_sha_ll_fill_text_block_sha256_inter();
-        //sha_ll_start_block(SHA2_256);
-        REG_WRITE(SHA_START_REG, 1);
-        sha_ll_load(SHA2_256);
-        nerd_sha_hal_wait_idle();
-        if (nerd_sha_ll_read_digest_if(hash))
-        {
-          //Serial.printf("Hw 16bit Share, nonce=0x%X\n", n);
+  esp_sha_acquire_hardware();
+  REG_WRITE(SHA_MODE_REG, SHA2_256);
+  uint32_t nend = job->nonce_start + job->nonce_count;
+  uint32_t nonces_done = job->nonce_count;
+  for (uint32_t n = job->nonce_start; n != nend; ++n)  //Ranges can wrap past 0xFFFFFFFF
+  {
+    //nerd_sha_hal_wait_idle();
+    nerd_sha_ll_write_digest(digest_mid);
+    //nerd_sha_hal_wait_idle();
+    nerd_sha_ll_fill_text_block_sha256(sha_buffer, n);
+    //sha_ll_continue_block(SHA2_256);
+    REG_WRITE(SHA_CONTINUE_REG, 1);
+    
+    sha_ll_load(SHA2_256);
+    nerd_sha_hal_wait_idle();
+    nerd_sha_ll_fill_text_block_sha256_inter();
+    //sha_ll_start_block(SHA2_256);
+    REG_WRITE(SHA_START_REG, 1);
+    sha_ll_load(SHA2_256);
+    nerd_sha_hal_wait_idle();
+    if (nerd_sha_ll_read_digest_if(hash))
+    {
+      //Serial.printf("Hw 16bit Share, nonce=0x%X\n", n);
 #ifdef VALIDATION
-          //Validation
-          ((uint32_t*)(job->sha_buffer+64+12))[0] = n;
-          nerd_sha256d_baked(diget_mid, job->sha_buffer+64, bake, doubleHash);
-          for (int i = 0; i < 32; ++i)
-          {
-            if (hash[i] != doubleHash[i])
-            {
-              Serial.println("***HW sha256 esp32s3 bug detected***");
-              break;
-            }
-          }
-#endif
-          //~5 per second
-          double diff_hash = diff_from_target(hash);
-          if (diff_hash > result->difficulty)
-          {
-            if (isSha256Valid(hash))
-            {
-              result->difficulty = diff_hash;
-              result->nonce = n;
-              memcpy(result->hash, hash, sizeof(hash));
-            }
-          }
-        }
-        if (
-             (uint8_t)(n & 0xFF) == 0 &&
-             s_working_current_job_id != job_in_work)
+      //Validation
+      ((uint32_t*)(job->sha_buffer+64+12))[0] = n;
+      nerd_sha256d_baked(diget_mid, job->sha_buffer+64, bake, doubleHash);
+      for (int i = 0; i < 32; ++i)
+      {
+        if (hash[i] != doubleHash[i])
         {
-          result->nonce_count = n-job->nonce_start+1;
+          Serial.println("***HW sha256 esp32s3 bug detected***");
           break;
         }
       }
-      esp_sha_release_hardware();
+#endif
+      //~5 per second
+      if (uint256_hash_below(hash, &found.threshold) && isSha256Valid(hash))
+        CandidatesAdd(found, job, n, hash);
+    }
+    if (
+         (n & abort_mask) == 0 &&
+         JobStale(job->id))
+    {
+      nonces_done = n-job->nonce_start+1;
+      break;
+    }
+  }
+  esp_sha_release_hardware();
+  return nonces_done;
+}
+
+void minerWorkerHw(void * task_id)
+{
+  unsigned int miner_id = (uint32_t)task_id;
+  Serial.printf("[MINER] %d Started minerWorkerHw Task!\n", miner_id);
+  MinerStats &stats = MinerRegister(MINER_ENGINE_HW);
+
+  JobRequest &job_data = MinerBuffer(s_miner_jobs, stats);
+  Candidates &found = MinerBuffer(s_miner_found, stats);
+  JobRequest* job = NULL;
+  uint32_t wdt_counter = 0;
+  ChunkTuner tuner;
+  ChunkTunerSet(tuner, MinerPlanNonces(miner_id, NONCE_PER_JOB_HW));
+
+  while (1)
+  {
+    job = WorkClaim(job_data, tuner.nonces, true) ? &job_data : NULL;
+    if (job)
+    {
+      uint32_t time_start = micros();
+      uint32_t nonces_done = MinerHashHw(job, found, tuner.abort_mask);
+      uint32_t busy_us = micros() - time_start;
+      ChunkTunerUpdate(tuner, nonces_done, busy_us);
+      MinerChunkDone(stats, job, found, nonces_done, busy_us);
     } else
-      vTaskDelay(2 / portTICK_PERIOD_MS);
+      MinerIdle(stats);
 
     wdt_counter++;
     if (wdt_counter >= 8)
@@ -1029,93 +1654,83 @@ static inline void nerd_sha_ll_fill_text_block_sha256_double()
     reg_addr_buf[15] = 0x00000100;
 }
 
-void minerWorkerHw(void * task_id)
+//Hashes a claimed range into found with the sha engine, stops early when the job goes stale. Returns the nonces done
+static uint32_t MinerHashHw(JobRequest* job, Candidates &found, uint32_t abort_mask)
 {
-  unsigned int miner_id = (uint32_t)task_id;
-  Serial.printf("[MINER] %d Started minerWorkerHwEsp32D Task!\n", miner_id);
-
-  std::shared_ptr<JobRequest> job;
-  std::shared_ptr<JobResult> result;
   uint8_t hash[32];
   uint8_t sha_buffer[128];
 
-  while (1)
+  CandidatesStart(found, job);
+  memcpy(sha_buffer, job->sha_buffer, 80);
+
+  uint32_t nonces_done = job->nonce_count;
+  esp_sha_lock_engine(SHA2_256);
+  for (uint32_t n = 0; n < job->nonce_count; ++n)
   {
+    //((uint32_t*)(sha_buffer+64+12))[0] = __builtin_bswap32(job->nonce_start+n);
+
+    //sha_hal_hash_block(SHA2_256, s_test_buffer, 64/4, true);
+    //nerd_sha_hal_wait_idle();
+    nerd_sha_ll_fill_text_block_sha256(sha_buffer);
+    sha_ll_start_block(SHA2_256);
+
+    //sha_hal_hash_block(SHA2_256, s_test_buffer+64, 64/4, false);
+    nerd_sha_hal_wait_idle();
+    nerd_sha_ll_fill_text_block_sha256_upper(sha_buffer+64, job->nonce_start+n);
+    sha_ll_continue_block(SHA2_256);
+
+    nerd_sha_hal_wait_idle();
+    sha_ll_load(SHA2_256);
+
+    //sha_hal_hash_block(SHA2_256, interResult, 64/4, true);
+    nerd_sha_hal_wait_idle();
+    nerd_sha_ll_fill_text_block_sha256_double();
+    sha_ll_start_block(SHA2_256);
+
+    nerd_sha_hal_wait_idle();
+    sha_ll_load(SHA2_256);
+    if (nerd_sha_ll_read_digest_swap_if(hash))
     {
-      std::lock_guard<std::mutex> lock(s_job_mutex);
-      if (result)
-      {
-        if (s_job_result_list.size() < 16)
-          s_job_result_list.push_back(result);
-        result.reset();
-      }
-      if (!s_job_request_list_hw.empty())
-      {
-        job = s_job_request_list_hw.front();
-        s_job_request_list_hw.pop_front();
-      } else
-        job.reset();
+      //~5 per second
+      if (uint256_hash_below(hash, &found.threshold) && isSha256Valid(hash))
+        CandidatesAdd(found, job, job->nonce_start+n, hash);
     }
-    if (job)
+    if (
+         (n & abort_mask) == 0 &&
+         JobStale(job->id))
     {
-      result = std::make_shared<JobResult>();
-      result->id = job->id;
-      result->nonce = 0xFFFFFFFF;
-      result->nonce_count = job->nonce_count;
-      result->difficulty = job->difficulty;
-      uint8_t job_in_work = job->id & 0xFF;
-      memcpy(sha_buffer, job->sha_buffer, 80);
-
-      esp_sha_lock_engine(SHA2_256);
-      for (uint32_t n = 0; n < job->nonce_count; ++n)
-      {
-        //((uint32_t*)(sha_buffer+64+12))[0] = __builtin_bswap32(job->nonce_start+n);
-
-        //sha_hal_hash_block(SHA2_256, s_test_buffer, 64/4, true);
-        //nerd_sha_hal_wait_idle();
-        nerd_sha_ll_fill_text_block_sha256(sha_buffer);
-        sha_ll_start_block(SHA2_256);
-
-        //sha_hal_hash_block(SHA2_256, s_test_buffer+64, 64/4, false);
-        nerd_sha_hal_wait_idle();
-        nerd_sha_ll_fill_text_block_sha256_upper(sha_buffer+64, job->nonce_start+n);
-        sha_ll_continue_block(SHA2_256);
+      nonces_done = n+1;
+      break;
+    }
+  }
+  esp_sha_unlock_engine(SHA2_256);
+  return nonces_done;
+}
 
-        nerd_sha_hal_wait_idle();
-        sha_ll_load(SHA2_256);
+void minerWorkerHw(void * task_id)
+{
+  unsigned int miner_id = (uint32_t)task_id;
+  Serial.printf("[MINER] %d Started minerWorkerHwEsp32D Task!\n", miner_id);
+  MinerStats &stats = MinerRegister(MINER_ENGINE_HW);
 
-        //sha_hal_hash_block(SHA2_256, interResult, 64/4, true);
-        nerd_sha_hal_wait_idle();
-        nerd_sha_ll_fill_text_block_sha256_double();
-        sha_ll_start_block(SHA2_256);
+  JobRequest &job_data = MinerBuffer(s_miner_jobs, stats);
+  Candidates &found = MinerBuffer(s_miner_found, stats);
+  JobRequest* job = NULL;
+  ChunkTuner tuner;
+  ChunkTunerSet(tuner, MinerPlanNonces(miner_id, NONCE_PER_JOB_HW));
 
-        nerd_sha_hal_wait_idle();
-        sha_ll_load(SHA2_256);
-        if (nerd_sha_ll_read_digest_swap_if(hash))
-        {
-          //~5 per second
-          double diff_hash = diff_from_target(hash);
-          if (diff_hash > result->difficulty)
-          {
-            if (isSha256Valid(hash))
-            {
-              result->difficulty = diff_hash;
-              result->nonce = job->nonce_start+n;
-              memcpy(result->hash, hash, sizeof(hash));
-            }
-          }
-        }
-        if (
-             (uint8_t)(n & 0xFF) == 0 &&
-             s_working_current_job_id != job_in_work)
-        {
-          result->nonce_count = n+1;
-          break;
-        }
-      }
-      esp_sha_unlock_engine(SHA2_256);
+  while (1)
+  {
+    job = WorkClaim(job_data, tuner.nonces, true) ? &job_data : NULL;
+    if (job)
+    {
+      uint32_t time_start = micros();
+      uint32_t nonces_done = MinerHashHw(job, found, tuner.abort_mask);
+      uint32_t busy_us = micros() - time_start;
+      ChunkTunerUpdate(tuner, nonces_done, busy_us);
+      MinerChunkDone(stats, job, found, nonces_done, busy_us);
     } else
-      vTaskDelay(2 / portTICK_PERIOD_MS);
+      MinerIdle(stats);
 
     esp_task_wdt_reset();
   }
@@ -1125,6 +1740,87 @@ void minerWorkerHw(void * task_id)
 
 #endif  //HARDWARE_SHA265
 
+//Hashes per second of a kernel on the calling task, over a zeroed job no hash can beat
+static uint32_t MinerBenchmark(uint32_t (*hash)(JobRequest*, Candidates&, uint32_t), uint32_t nonces)
+{
+  JobRequest job;
+  Candidates found;
+  memset(&job, 0, sizeof(job));
+  job.id = s_job_generation.load(std::memory_order_relaxed);  //never stale
+  job.nonce_count = nonces;
+
+  uint32_t time_start = micros();
+  uint32_t nonces_done = hash(&job, found, 0xFFFFFFFF);
+  uint32_t elapsed = micros() - time_start;
+  return elapsed > 0 ? (uint32_t)((uint64_t)nonces_done * 1000000 / elapsed) : 0;
+}
+
+//Benchmark of one kernel on a task pinned to core, the calling task waits for it
+#define MINER_BENCHMARK_STACK 6656
+struct MinerBenchmarkRun
+{
+  uint32_t (*hash)(JobRequest*, Candidates&, uint32_t);
+  uint32_t nonces;
+  uint32_t rate;
+  TaskHandle_t caller;
+};
+
+static void MinerBenchmarkTask(void* arg)
+{
+  MinerBenchmarkRun* run = (MinerBenchmarkRun*)arg;
+  run->rate = MinerBenchmark(run->hash, run->nonces);
+  xTaskNotifyGive(run->caller);
+  vTaskDelete(NULL);
+}
+
+static uint32_t MinerBenchmarkOn(uint8_t core, uint32_t (*hash)(JobRequest*, Candidates&, uint32_t), uint32_t nonces)
+{
+  MinerBenchmarkRun run = { hash, nonces, 0, xTaskGetCurrentTaskHandle() };
+  if (xTaskCreatePinnedToCore(MinerBenchmarkTask, "MinerBench", MINER_BENCHMARK_STACK, &run, 1, NULL, core) != pdPASS)
+    return MinerBenchmark(hash, nonces);
+  ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  return run.rate;
+}
+
+//Benchmarks the sw and hw kernels on every core, with wifi already running, and plans one
+//miner pinned to each core. There is one sha engine, so at most one hw miner: it goes to the
+//core where swapping its sw miner for it gains the most, none when hw never beats sw
+miner_plan minerSchedule(uint8_t cores)
+{
+  miner_plan plan;
+  memset(&plan, 0, sizeof(plan));
+  plan.miners = cores < MINER_PLAN_MAX ? cores : MINER_PLAN_MAX;
+  if (plan.miners == 0)
+    plan.miners = 1;
+
+  int hw_core = -1;
+  int32_t hw_gain = 0;
+  for (uint8_t c = 0; c < plan.miners; ++c)
+  {
+    plan.core[c] = c;
+    plan.sw_rate[c] = MinerBenchmarkOn(c, MinerHashSw, NONCE_PER_JOB_SW);
+    #ifdef HARDWARE_SHA265
+    plan.hw_rate[c] = MinerBenchmarkOn(c, MinerHashHw, NONCE_PER_JOB_HW);
+    #endif
+    int32_t gain = (int32_t)(plan.hw_rate[c] - plan.sw_rate[c]);
+    if (gain > hw_gain)
+    {
+      hw_gain = gain;
+      hw_core = c;
+    }
+  }
+
+  for (uint8_t i = 0; i < plan.miners; ++i)
+  {
+    plan.hw[i] = i == hw_core;
+    plan.rate[i] = plan.hw[i] ? plan.hw_rate[i] : plan.sw_rate[i];
+    Serial.printf("[MINER] Core %u benchmark sw %u H/s, hw %u H/s: miner %u on %s\n",
+                  plan.core[i], plan.sw_rate[i], plan.hw_rate[i], i, plan.hw[i] ? "hw" : "sw");
+  }
+  s_miner_plan = plan;
+  return plan;
+}
+
 
 #define DELAY 100
 #define REDRAW_EVERY 10
@@ -1197,7 +1893,8 @@ void saveStat() {
 
 void resetStat() {
     Serial.printf("[MONITOR] Resetting NVS stats\n");
-    templates = hashes = Mhashes = totalKHashes = elapsedKHs = upTime = shares = valids = 0;
+    templates = Mhashes = totalKHashes = elapsedKHs = upTime = shares = valids = 0;
+    totalHashes = 0;
     best_diff = 0.0;
     saveStat();
 }
@@ -1216,7 +1913,8 @@ void runMonitor(void *name)
 
   uint32_t seconds_elapsed = 0;
 
-  totalKHashes = (Mhashes * 1000) + hashes / 1000;
+  totalHashes = (uint64_t)Mhashes * 1000000;
+  totalKHashes = totalHashes / 1000;
   uint32_t last_update_millis = millis();
   uint32_t uptime_frac = 0;
 
@@ -1231,9 +1929,7 @@ void runMonitor(void *name)
     { 
       mLastCheck = now_millis;
       last_update_millis = now_millis;
-      unsigned long currentKHashes = (Mhashes * 1000) + hashes / 1000;
-      elapsedKHs = currentKHashes - totalKHashes;
-      totalKHashes = currentKHashes;
+      MinerStatsCollect(mElapsed);
 
       uptime_frac += mElapsed;
       while (uptime_frac >= 1000)
@@ -1258,6 +1954,24 @@ void runMonitor(void *name)
       Serial.printf("### Max stack usage: %d\n", uxTaskGetStackHighWaterMark(NULL));
       #endif
 
+      #ifdef DEBUG_MINING
+      Serial.printf("### Job switch latency [last / max]: %u / %u us\n", jobSwitchLatency_us, jobSwitchLatencyMax_us);
+      Serial.printf("### Submits [sent / accepted / rejected / stale / lost]: %u / %u / %u / %u / %u, rtt [last / max]: %u / %u ms\n",
+                    submitStats.sent.load(std::memory_order_relaxed), submitStats.accepted.load(std::memory_order_relaxed),
+                    submitStats.rejected.load(std::memory_order_relaxed), submitStats.stale.load(std::memory_order_relaxed),
+                    submitStats.lost.load(std::memory_order_relaxed),
+                    submitStats.rtt_last_us.load(std::memory_order_relaxed) / 1000, submitStats.rtt_max_us.load(std::memory_order_relaxed) / 1000);
+      Serial.print("### Submit rtt histogram:");
+      for (uint32_t b = 0; b < SUBMIT_RTT_BUCKETS; b++)
+      {
+        if (b < SUBMIT_RTT_BUCKETS - 1)
+          Serial.printf(" <%ums %u", SubmitTracker::rttBucketLimit_ms(b), submitStats.rtt[b].load(std::memory_order_relaxed));
+        else
+          Serial.printf(" >=%ums %u", SubmitTracker::rttBucketLimit_ms(b - 1), submitStats.rtt[b].load(std::memory_order_relaxed));
+      }
+      Serial.println();
+      #endif
+
       seconds_elapsed++;
 
       if(seconds_elapsed % (saveIntervals[currentIntervalIndex]) == 0){
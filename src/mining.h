@@ -24,6 +24,19 @@ void runMiner(void *name);
 void minerWorkerSw(void * task_id);
 void minerWorkerHw(void * task_id);
 
+#define MINER_PLAN_MAX 2
+
+typedef struct{
+  uint8_t miners;                   //one per core
+  bool hw[MINER_PLAN_MAX];          //miner runs minerWorkerHw
+  uint8_t core[MINER_PLAN_MAX];     //core the miner is pinned to
+  uint32_t rate[MINER_PLAN_MAX];    //expected hashes per second of the miner
+  uint32_t sw_rate[MINER_PLAN_MAX]; //boot benchmark of each core, hashes per second
+  uint32_t hw_rate[MINER_PLAN_MAX];
+} miner_plan;
+
+miner_plan minerSchedule(uint8_t cores);
+
 String printLocalTime(void);
 
 void resetStat();
@@ -12,7 +12,6 @@
 #include "drivers/devices/device.h"
 
 extern uint32_t templates;
-extern uint32_t hashes;
 extern uint32_t Mhashes;
 extern uint32_t totalKHashes;
 extern uint32_t elapsedKHs;
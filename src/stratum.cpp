@@ -5,6 +5,7 @@
 #include "cJSON.h"
 #include <string.h>
 #include <stdio.h>
+#include <ctype.h>
 #include "esp_log.h"
 #include "lwip/sockets.h"
 #include "utils.h"
@@ -24,13 +25,11 @@ unsigned long getNextId(unsigned long id) {
     return ++id;
 }
 
-//Verify Payload doesn't has zero lenght
-bool verifyPayload (String* line){
-  if(line->length() == 0) return false;
-  line->trim();
-  if(line->isEmpty()) return false;
-  return true;
-  
+//Verify Payload doesn't has zero lenght, trims the view
+bool verifyPayload (const char* &line, size_t &len){
+  while(len > 0 && isspace((unsigned char)line[0])) { line++; len--; }
+  while(len > 0 && isspace((unsigned char)line[len - 1])) len--;
+  return len != 0;
 }
 
 bool checkError(const StaticJsonDocument<BUFFER_JSON_DOC> doc) {
@@ -45,6 +44,61 @@ bool checkError(const StaticJsonDocument<BUFFER_JSON_DOC> doc) {
 }
 
 
+// STEP 0: Version rolling negotiation (CONFIGURE)
+    // Docs:
+    // - https://github.com/slushpool/stratumprotocol/blob/master/stratum-extensions.mediawiki
+    // - BIP310 / BIP320
+bool tx_mining_configure(WiFiClient& client, mining_subscribe& mSubscribe)
+{
+    char payload[BUFFER] = {0};
+
+    mSubscribe.version_mask = 0;
+
+    id = 1; //Initialize id messages
+    sprintf(payload, "{\"id\": %u, \"method\": \"mining.configure\", \"params\": [[\"version-rolling\"], {\"version-rolling.mask\": \"%08x\", \"version-rolling.min-bit-count\": 2}]}\n",
+      id, VERSION_ROLLING_MASK);
+
+    Serial.printf("[WORKER] ==> Mining configure\n");
+    Serial.print("  Sending  : "); Serial.println(payload);
+    client.print(payload);
+
+    //Not waited for, pools without the extension answer with an error or not at all. The
+    //answer is picked out by its id wherever it comes, version rolling starts from there
+    mSubscribe.configure_id = id;
+    return true;
+}
+
+//True when answer_id is the pending mining.configure, the line is used up then
+bool parse_mining_configure_answer(const char* line, size_t len, unsigned long answer_id, mining_subscribe& mSubscribe)
+{
+    if (mSubscribe.configure_id == 0 || answer_id != mSubscribe.configure_id)
+        return false;
+    mSubscribe.configure_id = 0;
+    if (parse_mining_configure(line, len, mSubscribe))
+        Serial.printf("    version_mask: %08x\n", mSubscribe.version_mask);
+    else
+        Serial.println("    Version rolling refused by the pool");
+    return true;
+}
+
+bool parse_mining_configure(const char* line, size_t len, mining_subscribe& mSubscribe)
+{
+    if(!verifyPayload(line, len)) return false;
+    Serial.print("  Receiving: "); Serial.write(line, len); Serial.println();
+
+    DeserializationError error = deserializeJson(doc, line, len);
+
+    if (error || checkError(doc)) return false;
+    if (!doc.containsKey("result")) return false;
+    if (!(bool)doc["result"]["version-rolling"]) return false;
+
+    const char* mask = doc["result"]["version-rolling.mask"];
+    if (mask == NULL) return false;
+    mSubscribe.version_mask = strtoul(mask, NULL, 16) & VERSION_ROLLING_MASK;
+
+    return true;
+}
+
 // STEP 1: Pool server connection (SUBSCRIBE)
     // Docs: 
     // - https://cs.braiins.com/stratum-v1/docs
@@ -54,7 +108,7 @@ bool tx_mining_subscribe(WiFiClient& client, mining_subscribe& mSubscribe)
     char payload[BUFFER] = {0};
     
     // Subscribe
-    id = 1; //Initialize id messages
+    id = getNextId(id);
     #ifndef HAN
     sprintf(payload, "{\"id\": %u, \"method\": \"mining.subscribe\", \"params\": [\"NerdMinerV2/%s\"]}\n", id, CURRENT_VERSION);
     #else
@@ -68,7 +122,15 @@ bool tx_mining_subscribe(WiFiClient& client, mining_subscribe& mSubscribe)
     vTaskDelay(200 / portTICK_PERIOD_MS); //Small delay
     
     String line = client.readStringUntil('\n');
-    if(!parse_mining_subscribe(line, mSubscribe)) return false;
+    //The mining.configure answer can still be in front, it is used and not dropped
+    for (int lines = 0; lines < 4; lines++) {
+        unsigned long answer_id = parse_extract_id(line.c_str(), line.length());
+        if (answer_id == id)
+            break;
+        parse_mining_configure_answer(line.c_str(), line.length(), answer_id, mSubscribe);
+        line = client.readStringUntil('\n');
+    }
+    if(!parse_mining_subscribe(line.c_str(), line.length(), mSubscribe)) return false;
 
   
     Serial.print("    sub_details: "); Serial.println(mSubscribe.sub_details);
@@ -85,12 +147,12 @@ bool tx_mining_subscribe(WiFiClient& client, mining_subscribe& mSubscribe)
     return true;
 }
 
-bool parse_mining_subscribe(String line, mining_subscribe& mSubscribe)
+bool parse_mining_subscribe(const char* line, size_t len, mining_subscribe& mSubscribe)
 {
-    if(!verifyPayload(&line)) return false;
-    Serial.print("  Receiving: "); Serial.println(line);
+    if(!verifyPayload(line, len)) return false;
+    Serial.print("  Receiving: "); Serial.write(line, len); Serial.println();
    
-    DeserializationError error = deserializeJson(doc, line);
+    DeserializationError error = deserializeJson(doc, line, len);
 
     if (error || checkError(doc)) return false;
     if (!doc.containsKey("result")) return false;
@@ -109,6 +171,8 @@ mining_subscribe init_mining_subscribe(void)
     new_mSub.extranonce1 = "";
     new_mSub.extranonce2 = "";
     new_mSub.extranonce2_size = 0;
+    new_mSub.version_mask = 0;
+    new_mSub.configure_id = 0;
     new_mSub.sub_details = "";
 
 
@@ -138,12 +202,28 @@ bool tx_mining_auth(WiFiClient& client, const char * user, const char * pass)
 }
 
 
-stratum_method parse_mining_method(String line)
+stratum_method parse_mining_method(const char* line, size_t len, mining_job& notify)
 {
-    if(!verifyPayload(&line)) return STRATUM_PARSE_ERROR;
-    Serial.print("  Receiving: "); Serial.println(line);
+    if(!verifyPayload(line, len)) return STRATUM_PARSE_ERROR;
+    Serial.print("  Receiving: "); Serial.write(line, len); Serial.println();
+
+    //Jobs are the longest messages, decoded straight to bytes without the json document
+    if (stratum_notify_decode(line, len, notify)) {
+        Serial.println("    Parsing Method [MINING NOTIFY]");
+        #ifdef DEBUG_MINING
+        Serial.print("    job_id: "); Serial.println(notify.job_id);
+        Serial.print("    coinb1 bytes: "); Serial.println(notify.coinb1_size);
+        Serial.print("    coinb2 bytes: "); Serial.println(notify.coinb2_size);
+        Serial.print("    merkle_branch size: "); Serial.println(notify.merkle_count);
+        Serial.printf("    version: %08x\n", notify.version);
+        Serial.printf("    nbits: %08x\n", notify.nbits);
+        Serial.printf("    ntime: %08x\n", notify.ntime);
+        Serial.print("    clean_jobs: "); Serial.println(notify.clean_jobs);
+        #endif
+        return MINING_NOTIFY;
+    }
     
-    DeserializationError error = deserializeJson(doc, line);
+    DeserializationError error = deserializeJson(doc, line, len);
 
     if (error || checkError(doc)) return STRATUM_PARSE_ERROR;
 
@@ -157,82 +237,40 @@ stratum_method parse_mining_method(String line)
     stratum_method result = STRATUM_UNKNOWN;
 
     if (strcmp("mining.notify", (const char*) doc["method"]) == 0) {
-        result = MINING_NOTIFY;
+        result = MINING_NOTIFY_ERROR;
     } else if (strcmp("mining.set_difficulty", (const char*) doc["method"]) == 0) {
         result = MINING_SET_DIFFICULTY;
+    } else if (strcmp("mining.set_version_mask", (const char*) doc["method"]) == 0) {
+        result = MINING_SET_VERSION_MASK;
     }
 
     return result;
 }
 
-bool parse_mining_notify(String line, mining_job& mJob)
-{
-    Serial.println("    Parsing Method [MINING NOTIFY]");
-    if(!verifyPayload(&line)) return false;
-   
-    DeserializationError error = deserializeJson(doc, line);
 
-    if (error) return false;
-    if (!doc.containsKey("params")) return false;
-
-    mJob.job_id = String((const char*) doc["params"][0]);
-    mJob.prev_block_hash = String((const char*) doc["params"][1]);
-    mJob.coinb1 = String((const char*) doc["params"][2]);
-    mJob.coinb2 = String((const char*) doc["params"][3]);
-    mJob.merkle_branch = doc["params"][4];
-    mJob.version = String((const char*) doc["params"][5]);
-    mJob.nbits = String((const char*) doc["params"][6]);
-    mJob.ntime = String((const char*) doc["params"][7]);
-    mJob.clean_jobs = doc["params"][8]; //bool
-
-    #ifdef DEBUG_MINING
-    Serial.print("    job_id: "); Serial.println(mJob.job_id);
-    Serial.print("    prevhash: "); Serial.println(mJob.prev_block_hash);
-    Serial.print("    coinb1: "); Serial.println(mJob.coinb1);
-    Serial.print("    coinb2: "); Serial.println(mJob.coinb2);
-    Serial.print("    merkle_branch size: "); Serial.println(mJob.merkle_branch.size());
-    Serial.print("    version: "); Serial.println(mJob.version);
-    Serial.print("    nbits: "); Serial.println(mJob.nbits);
-    Serial.print("    ntime: "); Serial.println(mJob.ntime);
-    Serial.print("    clean_jobs: "); Serial.println(mJob.clean_jobs);
-    #endif
-    //Check if parameters where correctly received
-    if (checkError(doc)) {
-      Serial.printf("[WORKER] >>>>>>>>> Work aborted\n"); 
-      return false;
-    }
-    return true;
-}
-
-
-bool tx_mining_submit(WiFiClient& client, mining_subscribe mWorker, mining_job mJob, unsigned long nonce, unsigned long &submit_id)
+bool tx_mining_submit(WiFiClient& client, stratum_submit& submit, uint64_t extranonce2, uint32_t ntime, uint32_t nonce, uint32_t version_bits, unsigned long &submit_id)
 {
-    char payload[BUFFER] = {0};
+    size_t len;
 
-    // Submit
+    if (submit.len == 0)
+        return false;
+
+    // Submit, the share goes out before anything is logged
     id = getNextId(id);
     submit_id = id;
-    sprintf(payload, "{\"id\":%u,\"method\":\"mining.submit\",\"params\":[\"%s\",\"%s\",\"%s\",\"%s\",\"%s\"]}\n",
-        id,
-        mWorker.wName,//"bc1qvv469gmw4zz6qa4u4dsezvrlmqcqszwyfzhgwj", //mWorker.name,
-        mJob.job_id.c_str(),
-        mWorker.extranonce2.c_str(),
-        mJob.ntime.c_str(),
-        String(nonce, HEX).c_str()
-        );
-    Serial.print("  Sending  : "); Serial.print(payload);
-    client.print(payload);
-    //Serial.print("  Receiving: "); Serial.println(client.readStringUntil('\n'));
+    const char* payload = stratum_submit_encode(submit, id, extranonce2, ntime, nonce, version_bits, len);
+    client.write((const uint8_t*)payload, len);
+    Serial.print("  Sending  : "); Serial.write(payload, len);
 
     return true;
 }
 
-bool parse_mining_set_difficulty(String line, double& difficulty)
+bool parse_mining_set_difficulty(const char* line, size_t len, double& difficulty)
 {
     Serial.println("    Parsing Method [SET DIFFICULTY]");
-    if(!verifyPayload(&line)) return false;
+    if(!verifyPayload(line, len)) return false;
    
-    DeserializationError error = deserializeJson(doc, line);
+    DeserializationError error = deserializeJson(doc, line, len);
 
     if (error) return false;
     if (!doc.containsKey("params")) return false;
@@ -243,6 +281,24 @@ bool parse_mining_set_difficulty(String line, double& difficulty)
     return true;
 }
 
+bool parse_mining_set_version_mask(const char* line, size_t len, uint32_t& version_mask)
+{
+    Serial.println("    Parsing Method [SET VERSION MASK]");
+    if(!verifyPayload(line, len)) return false;
+
+    DeserializationError error = deserializeJson(doc, line, len);
+
+    if (error) return false;
+    if (!doc.containsKey("params")) return false;
+
+    const char* mask = doc["params"][0];
+    if (mask == NULL) return false;
+    version_mask = strtoul(mask, NULL, 16) & VERSION_ROLLING_MASK;
+    Serial.printf("    version_mask: %08x\n", version_mask);
+
+    return true;
+}
+
 bool tx_suggest_difficulty(WiFiClient& client, double difficulty)
 {
     char payload[BUFFER] = {0};
@@ -256,9 +312,9 @@ bool tx_suggest_difficulty(WiFiClient& client, double difficulty)
 }
 
 
-unsigned long parse_extract_id(const String &line)
+unsigned long parse_extract_id(const char* line, size_t len)
 {
-    DeserializationError error = deserializeJson(doc, line);
+    DeserializationError error = deserializeJson(doc, line, len);
     if (error)
         return 0;
     
@@ -268,4 +324,48 @@ unsigned long parse_extract_id(const String &line)
     unsigned long id = doc["id"];
 
     return id;
-}
\ No newline at end of file
+}
+
+//Pools tell stale shares by the error code 21 "Job not found" or by the word in the reason
+static bool isStaleReason(int code, const char* reason)
+{
+    if (code == 21)
+        return true;
+    char lower[sizeof(((stratum_response*)0)->reason)];
+    size_t i = 0;
+    for (; reason[i] != '\0' && i < sizeof(lower) - 1; i++)
+        lower[i] = tolower((unsigned char)reason[i]);
+    lower[i] = '\0';
+    return strstr(lower, "stale") != NULL || strstr(lower, "job not found") != NULL;
+}
+
+bool parse_submit_response(const char* line, size_t len, stratum_response& response)
+{
+    if(!verifyPayload(line, len)) return false;
+
+    DeserializationError error = deserializeJson(doc, line, len);
+    if (error || !doc.containsKey("id") || doc["id"].isNull() || doc.containsKey("method"))
+        return false;
+
+    response.id = doc["id"];
+    response.error_code = 0;
+    response.reason[0] = '\0';
+
+    //"error": [code, "reason", traceback], a few pools send the reason alone
+    JsonVariant err = doc["error"];
+    const char* reason = NULL;
+    if (err.is<JsonArray>()) {
+        response.error_code = err[0] | 0;
+        reason = err[1];
+    } else if (err.is<const char*>()) {
+        reason = err;
+    }
+    if (reason != NULL) {
+        strncpy(response.reason, reason, sizeof(response.reason) - 1);
+        response.reason[sizeof(response.reason) - 1] = '\0';
+    }
+
+    response.accepted = err.isNull() && doc["result"].is<bool>() && (bool)doc["result"];
+    response.stale = !response.accepted && isStaleReason(response.error_code, response.reason);
+    return true;
+}
@@ -6,66 +6,79 @@
 #include <Arduino.h>
 #include <ArduinoJson.h>
 #include <WiFi.h>
+#include "stratum_job.h"
+#include "stratum_submit.h"
 
-#define MAX_MERKLE_BRANCHES 32
 #define HASH_SIZE 32
 #define COINBASE_SIZE 100
 #define COINBASE2_SIZE 128
 
+//BIP320 general purpose version bits
+#define VERSION_ROLLING_MASK 0x1FFFE000
+
 #define BUFFER_JSON_DOC 4096
 #define BUFFER 1024
+#define BUFFER_LINE 4096  //Longest pool message, notifies with big coinbases are the longest
 
 typedef struct {
     String sub_details;
     String extranonce1;
     String extranonce2;
     int extranonce2_size;
-    char wName[80];
+    uint32_t version_mask;  //Version bits the pool lets us roll, 0 without mining.configure
+    unsigned long configure_id;  //mining.configure waiting for its answer, 0 once answered
+    char wName[STRATUM_WORKER_MAX + 1];
     char wPass[20];
 } mining_subscribe;
 
+//Answer of the pool to one of our requests
 typedef struct {
-    String job_id;
-    String prev_block_hash;
-    String coinb1;
-    String coinb2;
-    String nbits;
-    JsonArray merkle_branch;
-    String version;
-    uint32_t target;
-    String ntime;
-    bool clean_jobs;
-} mining_job;
+    unsigned long id;
+    bool accepted;          //result true and error null
+    bool stale;             //rejected because the pool already dropped the job
+    int error_code;         //0 when the pool gave none
+    char reason[48];
+} stratum_response;
 
 typedef enum {
     STRATUM_SUCCESS,
     STRATUM_UNKNOWN,
     STRATUM_PARSE_ERROR,
     MINING_NOTIFY,
-    MINING_SET_DIFFICULTY
+    MINING_NOTIFY_ERROR,    //mining.notify that doesn't decode or fit a mining_job
+    MINING_SET_DIFFICULTY,
+    MINING_SET_VERSION_MASK
 } stratum_method;
 
 unsigned long getNextId(unsigned long id);
-bool verifyPayload (String* line);
+bool verifyPayload (const char* &line, size_t &len);
 bool checkError(const StaticJsonDocument<BUFFER_JSON_DOC> doc);
 
+//Method Mining.configure (BIP310 version rolling), the answer is matched by configure_id
+bool tx_mining_configure(WiFiClient& client, mining_subscribe& mSubscribe);
+bool parse_mining_configure(const char* line, size_t len, mining_subscribe& mSubscribe);
+bool parse_mining_configure_answer(const char* line, size_t len, unsigned long answer_id, mining_subscribe& mSubscribe);
+bool parse_mining_set_version_mask(const char* line, size_t len, uint32_t& version_mask);
+
 //Method Mining.subscribe
 mining_subscribe init_mining_subscribe(void);
 bool tx_mining_subscribe(WiFiClient& client, mining_subscribe& mSubscribe);
-bool parse_mining_subscribe(String line, mining_subscribe& mSubscribe);
+bool parse_mining_subscribe(const char* line, size_t len, mining_subscribe& mSubscribe);
 
 //Method Mining.authorise
 bool tx_mining_auth(WiFiClient& client, const char * user, const char * pass);
-stratum_method parse_mining_method(String line);
-bool parse_mining_notify(String line, mining_job& mJob);
+//mining.notify is decoded in the same pass into notify, left untouched for the other methods
+stratum_method parse_mining_method(const char* line, size_t len, mining_job& notify);
 
-//Method Mining.submit
-bool tx_mining_submit(WiFiClient& client, mining_subscribe mWorker, mining_job mJob, unsigned long nonce, unsigned long &submit_id);
+//Method Mining.submit, patched into the template of the share's job
+bool tx_mining_submit(WiFiClient& client, stratum_submit& submit, uint64_t extranonce2, uint32_t ntime, uint32_t nonce, uint32_t version_bits, unsigned long &submit_id);
 
 //Difficulty Methods 
 bool tx_suggest_difficulty(WiFiClient& client, double difficulty);
-bool parse_mining_set_difficulty(String line, double& difficulty);
+bool parse_mining_set_difficulty(const char* line, size_t len, double& difficulty);
 
-unsigned long parse_extract_id(const String &line);
+unsigned long parse_extract_id(const char* line, size_t len);
+//Result and error of an answer, false when it isn't one
+bool parse_submit_response(const char* line, size_t len, stratum_response& response);
 
 #endif // STRATUM_API_H
\ No newline at end of file
@@ -0,0 +1,45 @@
+#ifndef STRATUM_JOB_API_H
+#define STRATUM_JOB_API_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+
+#define MAX_MERKLE_BRANCHES 32
+#define STRATUM_JOB_ID_MAX  64
+#define STRATUM_COINB1_MAX  256
+#define STRATUM_COINB2_MAX  512
+
+/*
+ * mining.notify decoded to bytes. prev_block_hash is in header order (the
+ * 4 byte words of the stratum hex swapped), version, nbits and ntime are the
+ * values of their hex, the header takes them little endian. Owns all its
+ * data, nothing points into the json document or the receive buffer, so a
+ * job can be copied, queued or kept while later messages are parsed
+ */
+typedef struct {
+    char job_id[STRATUM_JOB_ID_MAX + 1];
+    uint8_t prev_block_hash[32];
+    uint8_t coinb1[STRATUM_COINB1_MAX];
+    size_t coinb1_size;
+    uint8_t coinb2[STRATUM_COINB2_MAX];
+    size_t coinb2_size;
+    uint8_t merkle_branch[MAX_MERKLE_BRANCHES][32];
+    size_t merkle_count;
+    uint32_t version;
+    uint32_t version_mask;
+    uint32_t nbits;
+    uint32_t ntime;
+    bool clean_jobs;
+} mining_job;
+
+static_assert(std::is_trivially_copyable<mining_job>::value, "mining_job is copied and queued as plain bytes");
+
+/*
+ * One pass over a pool message: true when it is a mining.notify whose params
+ * all decode into job. job is left half written otherwise, so decode into a
+ * spare job and only use it on success
+ */
+bool stratum_notify_decode(const char* line, size_t len, mining_job& job);
+
+#endif // STRATUM_JOB_API_H
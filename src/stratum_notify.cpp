@@ -0,0 +1,211 @@
+#include <string.h>
+#include "stratum_job.h"
+
+// Scanner over the message, just enough JSON for the pool messages
+typedef struct {
+    const char* p;
+    const char* end;
+} json_cursor;
+
+static void json_skip_ws(json_cursor& c) {
+    while (c.p < c.end && (*c.p == ' ' || *c.p == '\t' || *c.p == '\r' || *c.p == '\n'))
+        c.p++;
+}
+
+static bool json_expect(json_cursor& c, char ch) {
+    json_skip_ws(c);
+    if (c.p >= c.end || *c.p != ch)
+        return false;
+    c.p++;
+    return true;
+}
+
+// Raw contents between the quotes, escapes are skipped over but not decoded
+static bool json_string(json_cursor& c, const char*& s, size_t& n) {
+    if (!json_expect(c, '"'))
+        return false;
+    s = c.p;
+    while (c.p < c.end && *c.p != '"') {
+        if (*c.p == '\\')
+            c.p++;
+        c.p++;
+    }
+    if (c.p >= c.end)
+        return false;
+    n = c.p - s;
+    c.p++;
+    return true;
+}
+
+static bool json_skip_value(json_cursor& c) {
+    json_skip_ws(c);
+    if (c.p >= c.end)
+        return false;
+    if (*c.p == '"') {
+        const char* s;
+        size_t n;
+        return json_string(c, s, n);
+    }
+    if (*c.p != '[' && *c.p != '{') {
+        // Number or literal
+        while (c.p < c.end && *c.p != ',' && *c.p != ']' && *c.p != '}')
+            c.p++;
+        return true;
+    }
+    int depth = 0;
+    while (c.p < c.end) {
+        if (*c.p == '"') {
+            const char* s;
+            size_t n;
+            if (!json_string(c, s, n))
+                return false;
+            continue;
+        }
+        if (*c.p == '[' || *c.p == '{')
+            depth++;
+        else if (*c.p == ']' || *c.p == '}')
+            depth--;
+        c.p++;
+        if (depth == 0)
+            return true;
+    }
+    return false;
+}
+
+static inline int hex_nibble(char ch) {
+    if (ch >= '0' && ch <= '9') return ch - '0';
+    if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+    if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+    return -1;
+}
+
+// Hex string of at most max bytes
+static bool json_hex(json_cursor& c, uint8_t* out, size_t max, size_t& size) {
+    const char* s;
+    size_t n;
+    if (!json_string(c, s, n) || (n & 1) != 0 || n / 2 > max)
+        return false;
+    for (size_t i = 0; i < n / 2; i++) {
+        int hi = hex_nibble(s[2*i]);
+        int lo = hex_nibble(s[2*i + 1]);
+        if (hi < 0 || lo < 0)
+            return false;
+        out[i] = (hi << 4) | lo;
+    }
+    size = n / 2;
+    return true;
+}
+
+static bool json_hex_exact(json_cursor& c, uint8_t* out, size_t size) {
+    size_t decoded;
+    return json_hex(c, out, size, decoded) && decoded == size;
+}
+
+// 8 hex digits, most significant first
+static bool json_hex_u32(json_cursor& c, uint32_t& value) {
+    uint8_t bytes[4];
+    if (!json_hex_exact(c, bytes, 4))
+        return false;
+    value = (uint32_t)bytes[0] << 24 | (uint32_t)bytes[1] << 16 | (uint32_t)bytes[2] << 8 | bytes[3];
+    return true;
+}
+
+// [job_id, prevhash, coinb1, coinb2, [merkle branches], version, nbits, ntime, clean_jobs]
+static bool notify_params(json_cursor& c, mining_job& job) {
+    const char* s;
+    size_t n;
+
+    if (!json_expect(c, '['))
+        return false;
+    if (!json_string(c, s, n) || n > STRATUM_JOB_ID_MAX)
+        return false;
+    memcpy(job.job_id, s, n);
+    job.job_id[n] = '\0';
+
+    uint8_t prev_hash[32];
+    if (!json_expect(c, ',') || !json_hex_exact(c, prev_hash, 32))
+        return false;
+    for (int i = 0; i < 32; i++)
+        job.prev_block_hash[i] = prev_hash[(i & ~3) + 3 - (i & 3)];
+
+    if (!json_expect(c, ',') || !json_hex(c, job.coinb1, STRATUM_COINB1_MAX, job.coinb1_size))
+        return false;
+    if (!json_expect(c, ',') || !json_hex(c, job.coinb2, STRATUM_COINB2_MAX, job.coinb2_size))
+        return false;
+
+    if (!json_expect(c, ',') || !json_expect(c, '['))
+        return false;
+    job.merkle_count = 0;
+    json_skip_ws(c);
+    if (c.p < c.end && *c.p == ']') {
+        c.p++;
+    } else {
+        do {
+            if (job.merkle_count == MAX_MERKLE_BRANCHES ||
+                !json_hex_exact(c, job.merkle_branch[job.merkle_count], 32))
+                return false;
+            job.merkle_count++;
+        } while (json_expect(c, ','));
+        if (!json_expect(c, ']'))
+            return false;
+    }
+
+    if (!json_expect(c, ',') || !json_hex_u32(c, job.version))
+        return false;
+    if (!json_expect(c, ',') || !json_hex_u32(c, job.nbits))
+        return false;
+    if (!json_expect(c, ',') || !json_hex_u32(c, job.ntime))
+        return false;
+
+    if (!json_expect(c, ','))
+        return false;
+    json_skip_ws(c);
+    if (c.end - c.p >= 4 && memcmp(c.p, "true", 4) == 0) {
+        job.clean_jobs = true;
+        c.p += 4;
+    } else if (c.end - c.p >= 5 && memcmp(c.p, "false", 5) == 0) {
+        job.clean_jobs = false;
+        c.p += 5;
+    } else
+        return false;
+
+    // Extra params of newer pools are ignored
+    while (json_expect(c, ','))
+        if (!json_skip_value(c))
+            return false;
+    return json_expect(c, ']');
+}
+
+bool stratum_notify_decode(const char* line, size_t len, mining_job& job) {
+    json_cursor c = { line, line + len };
+    bool is_notify = false;
+    bool params = false;
+
+    if (!json_expect(c, '{'))
+        return false;
+    json_skip_ws(c);
+    if (c.p < c.end && *c.p == '}')
+        return false;
+    do {
+        const char* key;
+        size_t key_len;
+        if (!json_string(c, key, key_len) || !json_expect(c, ':'))
+            return false;
+        if (key_len == 6 && memcmp(key, "method", 6) == 0) {
+            const char* method;
+            size_t method_len;
+            if (!json_string(c, method, method_len))
+                return false;
+            is_notify = method_len == 13 && memcmp(method, "mining.notify", 13) == 0;
+            if (!is_notify)
+                return false;
+        } else if (key_len == 6 && memcmp(key, "params", 6) == 0) {
+            if (!notify_params(c, job))
+                return false;
+            params = true;
+        } else if (!json_skip_value(c))
+            return false;
+    } while (json_expect(c, ','));
+
+    return json_expect(c, '}') && is_notify && params;
+}
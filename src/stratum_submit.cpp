@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include <string.h>
+#include "stratum_submit.h"
+
+static const char s_hex[] = "0123456789abcdef";
+
+// Placeholder of n hex digits at the end of the template, returns its offset
+static uint16_t submit_field(stratum_submit& submit, size_t& at, size_t digits) {
+    uint16_t field = at + 2;
+    submit.payload[at++] = ',';
+    submit.payload[at++] = '"';
+    memset(submit.payload + at, '0', digits);
+    at += digits;
+    submit.payload[at++] = '"';
+    return field;
+}
+
+static void submit_hex_u32(char* out, uint32_t value) {
+    for (int i = 7; i >= 0; i--) {
+        out[i] = s_hex[value & 0xF];
+        value >>= 4;
+    }
+}
+
+bool stratum_submit_init(stratum_submit& submit, const char* worker, const char* job_id, int extranonce2_size, bool version_rolling) {
+    submit.len = 0;
+    if (extranonce2_size <= 0 || extranonce2_size > STRATUM_EXTRANONCE2_MAX)
+        return false;
+
+    int head = snprintf(submit.payload + STRATUM_SUBMIT_ID_ROOM, STRATUM_SUBMIT_MAX - STRATUM_SUBMIT_ID_ROOM,
+        ",\"method\":\"mining.submit\",\"params\":[\"%s\",\"%s\"", worker, job_id);
+    if (head < 0 || STRATUM_SUBMIT_ID_ROOM + (size_t)head + STRATUM_SUBMIT_TAIL_MAX > STRATUM_SUBMIT_MAX)
+        return false;
+
+    size_t at = STRATUM_SUBMIT_ID_ROOM + head;
+    submit.extranonce2_size = extranonce2_size;
+    submit.extranonce2_at = submit_field(submit, at, 2 * extranonce2_size);
+    submit.ntime_at = submit_field(submit, at, 8);
+    submit.nonce_at = submit_field(submit, at, 8);
+    submit.version_at = version_rolling ? submit_field(submit, at, 8) : 0;
+    memcpy(submit.payload + at, "]}\n", 3);
+    submit.len = at + 3;
+    return true;
+}
+
+const char* stratum_submit_encode(stratum_submit& submit, uint32_t id, uint64_t extranonce2, uint32_t ntime, uint32_t nonce, uint32_t version_bits, size_t& len) {
+    // extranonce2 as the big endian bytes it takes in the coinbase
+    char* en2 = submit.payload + submit.extranonce2_at;
+    for (int i = 2 * submit.extranonce2_size - 1; i >= 0; i--) {
+        en2[i] = s_hex[extranonce2 & 0xF];
+        extranonce2 >>= 4;
+    }
+    submit_hex_u32(submit.payload + submit.ntime_at, ntime);
+    submit_hex_u32(submit.payload + submit.nonce_at, nonce);
+    if (submit.version_at != 0)
+        submit_hex_u32(submit.payload + submit.version_at, version_bits);
+
+    // The id goes right before the params, so the message starts wherever its digits end
+    char* start = submit.payload + STRATUM_SUBMIT_ID_ROOM;
+    do {
+        *--start = '0' + id % 10;
+        id /= 10;
+    } while (id != 0);
+    start -= 6;
+    memcpy(start, "{\"id\":", 6);
+
+    len = submit.payload + submit.len - start;
+    return start;
+}
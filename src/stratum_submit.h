@@ -0,0 +1,44 @@
+#ifndef STRATUM_SUBMIT_API_H
+#define STRATUM_SUBMIT_API_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "stratum_job.h"
+
+#define STRATUM_SUBMIT_MAX       384
+#define STRATUM_SUBMIT_ID_ROOM   16   //'{"id":' and the 10 digits of a 32 bit id
+#define STRATUM_EXTRANONCE2_MAX  8
+#define STRATUM_WORKER_MAX       79   //Worker name, the wallet setting holds 79 chars
+
+//Params up to the job id, and after it the four placeholders with their quotes and commas and "]}\n"
+#define STRATUM_SUBMIT_HEAD_FIXED (sizeof(",\"method\":\"mining.submit\",\"params\":[\"\",\"\"") - 1)
+#define STRATUM_SUBMIT_TAIL_MAX   (4 * 3 + 2 * STRATUM_EXTRANONCE2_MAX + 3 * 8 + 3)
+
+//Every decoded job gets a template, init only fails on names longer than the limits
+static_assert(STRATUM_SUBMIT_ID_ROOM + STRATUM_SUBMIT_HEAD_FIXED + STRATUM_WORKER_MAX + STRATUM_JOB_ID_MAX +
+              STRATUM_SUBMIT_TAIL_MAX <= STRATUM_SUBMIT_MAX, "the longest mining.submit doesn't fit the template");
+
+/*
+ * mining.submit of one job serialised ahead of its shares. The worker name
+ * and job id are written once per job, extranonce2, ntime, nonce and the
+ * rolled version bits get placeholders at fixed offsets. A share only patches
+ * their hex and writes the request id in front of the params, the message is
+ * then sent as it lies in payload
+ */
+typedef struct {
+    char payload[STRATUM_SUBMIT_MAX];
+    uint16_t len;               //end of the message, '\n' included, 0 without a template
+    uint16_t extranonce2_at;
+    uint16_t ntime_at;
+    uint16_t nonce_at;
+    uint16_t version_at;        //0 without version rolling
+    uint8_t extranonce2_size;
+} stratum_submit;
+
+//false, and no template, when the extranonce2 size is out of range or the names don't fit
+bool stratum_submit_init(stratum_submit& submit, const char* worker, const char* job_id, int extranonce2_size, bool version_rolling);
+
+//Patches a share into the template, returns the message and its length
+const char* stratum_submit_encode(stratum_submit& submit, uint32_t id, uint64_t extranonce2, uint32_t ntime, uint32_t nonce, uint32_t version_bits, size_t& len);
+
+#endif // STRATUM_SUBMIT_API_H
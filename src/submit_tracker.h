@@ -0,0 +1,129 @@
+#ifndef SUBMIT_TRACKER_API_H
+#define SUBMIT_TRACKER_API_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+#define SUBMIT_PENDING_MAX  32  //Shares waiting for the pool's answer, older ones are counted lost
+#define SUBMIT_RTT_BUCKETS  8   //Round trip histogram, bucket b below 25ms << b, the last one open
+#define SUBMIT_RTT_BASE_MS  25
+
+typedef enum {
+  SUBMIT_ACCEPTED,
+  SUBMIT_REJECTED,
+  SUBMIT_STALE      //rejected for a job the pool already dropped
+} submit_outcome;
+
+struct Submition
+{
+  uint32_t id;
+  uint32_t sent_us;
+  double diff;
+  bool is32bit;
+  bool isValid;
+};
+
+//Counters of the submitted shares, written by the stratum task only and read by the monitor
+struct SubmitStats
+{
+  std::atomic<uint32_t> sent;
+  std::atomic<uint32_t> accepted;
+  std::atomic<uint32_t> rejected;
+  std::atomic<uint32_t> stale;
+  std::atomic<uint32_t> lost;         //never answered, evicted or dropped with the connection
+  std::atomic<uint32_t> rtt_last_us;
+  std::atomic<uint32_t> rtt_max_us;
+  std::atomic<uint32_t> rtt[SUBMIT_RTT_BUCKETS];
+};
+
+/*
+ * Pending mining.submit requests matched to the pool's answers by id,
+ * without allocating. Slots are reused in send order, so a full tracker
+ * overwrites the oldest unanswered share. Every answer adds its round trip
+ * to the histogram, whatever the outcome
+ */
+class SubmitTracker
+{
+public:
+  explicit SubmitTracker(SubmitStats &stats) : stats(stats), next(0)
+  {
+    for (uint32_t i = 0; i < SUBMIT_PENDING_MAX; ++i)
+      used[i] = false;
+  }
+
+  void sent(const Submition &submition)
+  {
+    if (used[next])
+      add(stats.lost, 1);
+    pending[next] = submition;
+    used[next] = true;
+    next = (next + 1) % SUBMIT_PENDING_MAX;
+    add(stats.sent, 1);
+  }
+
+  //false for ids not pending, answers to other requests or already evicted
+  bool answered(uint32_t id, uint32_t now_us, submit_outcome outcome, Submition &submition)
+  {
+    for (uint32_t i = 0; i < SUBMIT_PENDING_MAX; ++i)
+    {
+      if (!used[i] || pending[i].id != id)
+        continue;
+      used[i] = false;
+      submition = pending[i];
+
+      uint32_t rtt_us = now_us - submition.sent_us;
+      stats.rtt_last_us.store(rtt_us, std::memory_order_relaxed);
+      if (rtt_us > stats.rtt_max_us.load(std::memory_order_relaxed))
+        stats.rtt_max_us.store(rtt_us, std::memory_order_relaxed);
+      add(stats.rtt[rttBucket(rtt_us)], 1);
+      add(outcome == SUBMIT_ACCEPTED ? stats.accepted : outcome == SUBMIT_STALE ? stats.stale : stats.rejected, 1);
+      return true;
+    }
+    return false;
+  }
+
+  //Connection lost, answers to what is pending won't come
+  void clear()
+  {
+    for (uint32_t i = 0; i < SUBMIT_PENDING_MAX; ++i)
+    {
+      if (used[i])
+        add(stats.lost, 1);
+      used[i] = false;
+    }
+  }
+
+  uint32_t size() const
+  {
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < SUBMIT_PENDING_MAX; ++i)
+      n += used[i];
+    return n;
+  }
+
+  static uint32_t rttBucket(uint32_t rtt_us)
+  {
+    uint32_t b = 0;
+    while (b < SUBMIT_RTT_BUCKETS - 1 && rtt_us >= rttBucketLimit_ms(b) * 1000u)
+      b++;
+    return b;
+  }
+
+  //Upper bound of bucket b, the last one has none
+  static constexpr uint32_t rttBucketLimit_ms(uint32_t b) { return SUBMIT_RTT_BASE_MS << b; }
+
+private:
+  //Single writer, a load and a store are enough
+  static void add(std::atomic<uint32_t> &counter, uint32_t value)
+  {
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+  }
+
+  SubmitStats &stats;
+  Submition pending[SUBMIT_PENDING_MAX];
+  bool used[SUBMIT_PENDING_MAX];
+  uint32_t next;
+};
+
+#endif // SUBMIT_TRACKER_API_H
@@ -0,0 +1,84 @@
+#ifndef UINT256_API_H
+#define UINT256_API_H
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * 256bit unsigned integer, little endian words (word[0] is the least significant)
+ * so a hash as written by the miners can be compared as is
+ */
+typedef struct {
+  uint32_t word[8];
+} uint256;
+
+/* Share target for a pool difficulty, target = truediffone / diff. Call once per job, not per hash */
+static inline void uint256_from_diff(double diff, uint256* target)
+{
+  static const double truediffone = 26959535291011309493156476344723991336010898738574164086137773096960.0;
+  static const double bits64 = 18446744073709551616.0;
+  static const double bits128 = 340282366920938463463374607431768211456.0;
+  static const double bits192 = 6277101735386680763835789423207666416102355444464034512896.0;
+
+  double d64 = diff > 0 ? truediffone / diff : bits192 * bits64;
+  if (d64 >= bits192 * bits64)
+  {
+    memset(target->word, 0xFF, sizeof(target->word));
+    return;
+  }
+
+  uint64_t limb[4];
+  limb[3] = (uint64_t)(d64 / bits192);
+  d64 -= (double)limb[3] * bits192;
+  limb[2] = (uint64_t)(d64 / bits128);
+  d64 -= (double)limb[2] * bits128;
+  limb[1] = (uint64_t)(d64 / bits64);
+  d64 -= (double)limb[1] * bits64;
+  limb[0] = (uint64_t)d64;
+
+  for (int i = 0; i < 4; ++i)
+  {
+    target->word[2*i] = (uint32_t)limb[i];
+    target->word[2*i + 1] = (uint32_t)(limb[i] >> 32);
+  }
+}
+
+/* Block target from the compact nbits field */
+static inline void uint256_from_nbits(uint32_t nbits, uint256* target)
+{
+  int exponent = nbits >> 24;
+  uint32_t mantissa = nbits & 0x007FFFFF;
+
+  memset(target->word, 0, sizeof(target->word));
+  if (exponent < 3)
+  {
+    mantissa >>= 8 * (3 - exponent);
+    exponent = 3;
+  }
+  for (int k = 0; k < 3; ++k)
+  {
+    int pos = exponent - 3 + k;
+    if (pos < 32)
+      target->word[pos / 4] |= ((mantissa >> (8 * k)) & 0xFF) << (8 * (pos % 4));
+  }
+}
+
+static inline void uint256_from_hash(const uint8_t* hash, uint256* value)
+{
+  memcpy(value->word, hash, sizeof(value->word));
+}
+
+/* true when hash < target, no early exit so the cost is the same for every hash */
+static inline bool uint256_hash_below(const uint8_t* hash, const uint256* target)
+{
+  uint32_t h[8];
+  memcpy(h, hash, sizeof(h));
+
+  //Borrow of hash - target from the least significant word up
+  uint32_t borrow = 0;
+  for (int i = 0; i < 8; ++i)
+    borrow = (h[i] < target->word[i]) | ((h[i] == target->word[i]) & borrow);
+  return borrow != 0;
+}
+
+#endif // UINT256_API_H
@@ -3,7 +3,7 @@
 #include "utils.h"
 #include "mining.h"
 #include "stratum.h"
-#include "mbedtls/sha256.h"
+#include "ShaTests/nerdSHA256plus.h"
 
 #include <string.h>
 #include <stdio.h>
@@ -186,213 +186,127 @@ miner_data init_miner_data(void){
   return newMinerData;
 }
 
-miner_data calculateMiningData(mining_subscribe& mWorker, mining_job mJob){
-
-  miner_data mMiner = init_miner_data();
+// Exactly size bytes, to_byte_array() runs to the end of the string
+static void hex_to_bytes(const char *in, size_t size, uint8_t *out) {
+  for (size_t i = 0; i < size; i++)
+    out[i] = (hex(in[2*i]) << 4) | hex(in[2*i + 1]);
+}
 
-  // calculate target - target = (nbits[2:]+'00'*(int(nbits[:2],16) - 3)).zfill(64)
-    
-    char target[TARGET_BUFFER_SIZE+1];
-    memset(target, '0', TARGET_BUFFER_SIZE);
-    int zeros = (int) strtol(mJob.nbits.substring(0, 2).c_str(), 0, 16) - 3;
-    memcpy(target + zeros - 2, mJob.nbits.substring(2).c_str(), mJob.nbits.length() - 2);
-    target[TARGET_BUFFER_SIZE] = 0;
-    Serial.print("    target: "); Serial.println(target);
-    
-    // bytearray target
-    size_t size_target = to_byte_array(target, 32, mMiner.bytearray_target);
+/**
+ * extranonce2 as the big endian bytes it takes in the coinbase
+*/
+static void extranonce2_to_bytes(uint64_t extranonce2, int extranonce2_size, uint8_t *out) {
+  for (int i = 0; i < extranonce2_size; i++)
+    out[extranonce2_size - 1 - i] = i < 8 ? (uint8_t)(extranonce2 >> (8 * i)) : 0;
+}
 
-    for (size_t j = 0; j < 8; j++) {
-      mMiner.bytearray_target[j] ^= mMiner.bytearray_target[size_target - 1 - j];
-      mMiner.bytearray_target[size_target - 1 - j] ^= mMiner.bytearray_target[j];
-      mMiner.bytearray_target[j] ^= mMiner.bytearray_target[size_target - 1 - j];
-    }
+void extranonce2_to_hex(uint64_t extranonce2, int extranonce2_size, char *extranonce2_char) {
+  uint8_t bytes[COINBASE_EXTRANONCE2_MAX];
+  extranonce2_to_bytes(extranonce2, extranonce2_size, bytes);
+  for (int i = 0; i < extranonce2_size; i++)
+    snprintf(&extranonce2_char[i*2], 3, "%02x", bytes[i]);
+  extranonce2_char[extranonce2_size * 2] = 0;
+}
 
-    // get extranonce2 - extranonce2 = hex(random.randint(0,2**32-1))[2:].zfill(2*extranonce2_size)
-    //To review
-    //char extranonce2_char[2 * mWorker.extranonce2_size+1];	
-	//mWorker.extranonce2.toCharArray(extranonce2_char, 2 * mWorker.extranonce2_size + 1);
-    //getNextExtranonce2(mWorker.extranonce2_size, extranonce2_char);
-    if (mWorker.extranonce2_size == 2)
-        mWorker.extranonce2 = "0001";
-    else if (mWorker.extranonce2_size == 4)
-        mWorker.extranonce2 = "00000001";
-    else if (mWorker.extranonce2_size == 8)
-        mWorker.extranonce2 = "0000000000000001";
-    else
-    {
-        Serial.println("Unknown extranonce2");
-        mWorker.extranonce2 = "00000001";
-    }
-    //mWorker.extranonce2 = "00000002";
-    
-    //get coinbase - coinbase_hash_bin = hashlib.sha256(hashlib.sha256(binascii.unhexlify(coinbase)).digest()).digest()
-    // Use char buffer instead of String concatenation to avoid memory leaks
-    static char coinbase_buffer[512]; // Static buffer to avoid repeated allocation
-    snprintf(coinbase_buffer, sizeof(coinbase_buffer), "%s%s%s%s", 
-             mJob.coinb1.c_str(), mWorker.extranonce1.c_str(), 
-             mWorker.extranonce2.c_str(), mJob.coinb2.c_str());
-    Serial.print("    coinbase: "); Serial.println(coinbase_buffer);
-    size_t str_len = strlen(coinbase_buffer)/2;
-    uint8_t bytearray[str_len];
-
-    size_t res = to_byte_array(coinbase_buffer, str_len*2, bytearray);
+bool coinbase_midstate_init(coinbase_midstate& mCoinbase, mining_subscribe& mWorker, const mining_job& mJob) {
+  uint8_t chunk[64];
+  bool fits = true;
 
-    #ifdef DEBUG_MINING
-    Serial.print("    extranonce2: "); Serial.println(mWorker.extranonce2);
-    Serial.print("    coinbase: "); Serial.println(coinbase_buffer);
-    Serial.print("    coinbase bytes - size: "); Serial.println(res);
-    for (size_t i = 0; i < res; i++)
-        Serial.printf("%02x", bytearray[i]);
-    Serial.println("---");
-    #endif
-
-    mbedtls_sha256_context ctx;
-    mbedtls_sha256_init(&ctx);
-  
-    byte interResult[32]; // 256 bit
-    byte shaResult[32]; // 256 bit
-  
-    mbedtls_sha256_starts_ret(&ctx,0);
-    mbedtls_sha256_update_ret(&ctx, bytearray, str_len);
-    mbedtls_sha256_finish_ret(&ctx, interResult);
+  mCoinbase.extranonce2_size = mWorker.extranonce2_size;
+  if (mCoinbase.extranonce2_size <= 0 || mCoinbase.extranonce2_size > COINBASE_EXTRANONCE2_MAX) {
+    Serial.println("Unknown extranonce2");
+    mCoinbase.extranonce2_size = 4;
+    fits = false;
+  }
 
-    mbedtls_sha256_starts_ret(&ctx,0);
-    mbedtls_sha256_update_ret(&ctx, interResult, 32);
-    mbedtls_sha256_finish_ret(&ctx, shaResult);
-    mbedtls_sha256_free(&ctx);
+  // coinb1 + extranonce1, extranonce1 hashed in 64 byte chunks straight from hex
+  nerd_sha256_start(&mCoinbase.prefix);
+  nerd_sha256_update(&mCoinbase.prefix, mJob.coinb1, mJob.coinb1_size);
+  const char *extranonce1 = mWorker.extranonce1.c_str();
+  size_t len = strlen(extranonce1) / 2;
+  for (size_t off = 0; off < len; off += sizeof(chunk)) {
+    size_t n = len - off < sizeof(chunk) ? len - off : sizeof(chunk);
+    hex_to_bytes(extranonce1 + 2 * off, n, chunk);
+    nerd_sha256_update(&mCoinbase.prefix, chunk, n);
+  }
 
-    #ifdef DEBUG_MINING
-    Serial.print("    coinbase double sha: ");
+  // The decoder already bounded both to what the cache holds
+  mCoinbase.coinb2_size = mJob.coinb2_size;
+  memcpy(mCoinbase.coinb2, mJob.coinb2, mJob.coinb2_size);
+  mCoinbase.merkle_count = mJob.merkle_count;
+  memcpy(mCoinbase.merkle_branch, mJob.merkle_branch, mJob.merkle_count * 32);
+  #ifdef DEBUG_MINING
+  for (size_t k = 0; k < mCoinbase.merkle_count; k++) {
+    Serial.print("    merkle element    "); Serial.print(k); Serial.print(": ");
     for (size_t i = 0; i < 32; i++)
-        Serial.printf("%02x", shaResult[i]);
+      Serial.printf("%02x", mCoinbase.merkle_branch[k][i]);
     Serial.println("");
-    #endif
+  }
+  #endif
+  return fits;
+}
 
-    
-    // copy coinbase hash
-    memcpy(mMiner.merkle_result, shaResult, sizeof(shaResult));
-    
-    byte merkle_concatenated[32 * 2];
-    for (size_t k=0; k < mJob.merkle_branch.size(); k++) {
-        const char* merkle_element = (const char*) mJob.merkle_branch[k];
-        uint8_t bytearray[32];
-        size_t res = to_byte_array(merkle_element, 64, bytearray);
-
-        #ifdef DEBUG_MINING
-        Serial.print("    merkle element    "); Serial.print(k); Serial.print(": "); Serial.println(merkle_element);
-        #endif
-        for (size_t i = 0; i < 32; i++) {
-          merkle_concatenated[i] = mMiner.merkle_result[i];
-          merkle_concatenated[32 + i] = bytearray[i];
-        }
+void coinbase_merkle_root(const coinbase_midstate& mCoinbase, uint64_t extranonce2, uint8_t *merkle_root) {
+  uint8_t extranonce2_bytes[COINBASE_EXTRANONCE2_MAX];
+  extranonce2_to_bytes(extranonce2, mCoinbase.extranonce2_size, extranonce2_bytes);
 
-        #ifdef DEBUG_MINING
-        Serial.print("    merkle element    "); Serial.print(k); Serial.print(": "); Serial.println(merkle_element);
-        Serial.print("    merkle concatenated: ");
-        for (size_t i = 0; i < 64; i++)
-            Serial.printf("%02x", merkle_concatenated[i]);
-        Serial.println("");
-        #endif
-
-        mbedtls_sha256_context ctx;
-        mbedtls_sha256_init(&ctx);
-        mbedtls_sha256_starts_ret(&ctx,0);
-        mbedtls_sha256_update_ret(&ctx, merkle_concatenated, 64);
-        mbedtls_sha256_finish_ret(&ctx, interResult);
-
-        mbedtls_sha256_starts_ret(&ctx,0);
-        mbedtls_sha256_update_ret(&ctx, interResult, 32);
-        mbedtls_sha256_finish_ret(&ctx, mMiner.merkle_result);
-        mbedtls_sha256_free(&ctx);
-
-        #ifdef DEBUG_MINING
-        Serial.print("    merkle sha         : ");
-        for (size_t i = 0; i < 32; i++)
-            Serial.printf("%02x", mMiner.merkle_result[i]);
-        Serial.println("");
-        #endif
-    }
-    // merkle root from merkle_result
-    
-    Serial.print("    merkle sha         : ");
-    char merkle_root[65];
-    for (int i = 0; i < 32; i++) {
-      Serial.printf("%02x", mMiner.merkle_result[i]);
-      snprintf(&merkle_root[i*2], 3, "%02x", mMiner.merkle_result[i]);
-    }
-    merkle_root[65] = 0;
-    Serial.println("");
+  // Only the tail is hashed, on a copy of the cached prefix
+  nerdSHA256_stream ctx = mCoinbase.prefix;
+  nerd_sha256_update(&ctx, extranonce2_bytes, mCoinbase.extranonce2_size);
+  nerd_sha256_update(&ctx, mCoinbase.coinb2, mCoinbase.coinb2_size);
+  nerd_sha256d_finish(&ctx, merkle_root);
 
-    // calculate blockheader
-    // j.block_header = ''.join([j.version, j.prevhash, merkle_root, j.ntime, j.nbits])
-    String blockheader = mJob.version + mJob.prev_block_hash + String(merkle_root) + mJob.ntime + mJob.nbits + "00000000";
-    str_len = blockheader.length()/2;
-    
-    //uint8_t bytearray_blockheader[str_len];
-    res = to_byte_array(blockheader.c_str(), str_len*2, mMiner.bytearray_blockheader);
+  #ifdef DEBUG_MINING
+  Serial.print("    coinbase double sha: ");
+  for (size_t i = 0; i < 32; i++)
+      Serial.printf("%02x", merkle_root[i]);
+  Serial.println("");
+  #endif
 
-    #ifdef DEBUG_MINING
-    Serial.println("    blockheader: "); Serial.print(blockheader);
-    Serial.println("    blockheader bytes "); Serial.print(str_len); Serial.print(" -> ");
-    #endif
+  uint8_t merkle_concatenated[32 * 2];
+  for (size_t k = 0; k < mCoinbase.merkle_count; k++) {
+    memcpy(merkle_concatenated, merkle_root, 32);
+    memcpy(merkle_concatenated + 32, mCoinbase.merkle_branch[k], 32);
+    nerd_sha256d_64(merkle_concatenated, merkle_root);
+  }
+}
 
-    // reverse version
-    uint8_t buff;
-    size_t bword, bsize, boffset;
-    boffset = 0;
-    bsize = 4;
-    for (size_t j = boffset; j < boffset + (bsize/2); j++) {
-        buff = mMiner.bytearray_blockheader[j];
-        mMiner.bytearray_blockheader[j] = mMiner.bytearray_blockheader[2 * boffset + bsize - 1 - j];
-        mMiner.bytearray_blockheader[2 * boffset + bsize - 1 - j] = buff;
-    }
+miner_data calculateMiningData(mining_subscribe& mWorker, const mining_job& mJob, coinbase_midstate& mCoinbase){
 
-    // reverse prev hash (4-byte word swap)
-    boffset = 4;
-    bword = 4;
-    bsize = 32;
-    for (size_t i = 1; i <= bsize / bword; i++) {
-        for (size_t j = boffset; j < boffset + bword / 2; j++) {
-            buff = mMiner.bytearray_blockheader[j];
-            mMiner.bytearray_blockheader[j] = mMiner.bytearray_blockheader[2 * boffset + bword - 1 - j];
-            mMiner.bytearray_blockheader[2 * boffset + bword - 1 - j] = buff;
-        }
-        boffset += bword;
-    }
+  miner_data mMiner = init_miner_data();
 
-/*
-    // reverse merkle (4-byte word swap)
-    boffset = 36;
-    bword = 4;
-    bsize = 32;
-    for (size_t i = 1; i <= bsize / bword; i++) {
-        for (size_t j = boffset; j < boffset + bword / 2; j++) {
-            buff = mMiner.bytearray_blockheader[j];
-            mMiner.bytearray_blockheader[j] = mMiner.bytearray_blockheader[2 * boffset + bword - 1 - j];
-            mMiner.bytearray_blockheader[2 * boffset + bword - 1 - j] = buff;
-        }
-        boffset += bword;
-    }
-*/
-    // reverse ntime
-    boffset = 68;
-    bsize = 4;
-    for (size_t j = boffset; j < boffset + (bsize/2); j++) {
-        buff = mMiner.bytearray_blockheader[j];
-        mMiner.bytearray_blockheader[j] = mMiner.bytearray_blockheader[2 * boffset + bsize - 1 - j];
-        mMiner.bytearray_blockheader[2 * boffset + bsize - 1 - j] = buff;
-    }
+  // target from nbits, little endian like the hashes
+    uint256 target;
+    uint256_from_nbits(mJob.nbits, &target);
+    memcpy(mMiner.bytearray_target, target.word, sizeof(mMiner.bytearray_target));
 
-    // reverse difficulty
-    boffset = 72;
-    bsize = 4;
-    for (size_t j = boffset; j < boffset + (bsize/2); j++) {
-        buff = mMiner.bytearray_blockheader[j];
-        mMiner.bytearray_blockheader[j] = mMiner.bytearray_blockheader[2 * boffset + bsize - 1 - j];
-        mMiner.bytearray_blockheader[2 * boffset + bsize - 1 - j] = buff;
-    }
+    // Coinbase prefix hashed once per job, then coinbase + merkle fold for extranonce2 = 1
+    if (!coinbase_midstate_init(mCoinbase, mWorker, mJob))
+        Serial.println("Coinbase does not fit the midstate cache");
+
+    char extranonce2_char[2 * COINBASE_EXTRANONCE2_MAX + 1];
+    extranonce2_to_hex(1, mCoinbase.extranonce2_size, extranonce2_char);
+    mWorker.extranonce2 = extranonce2_char;
+
+    coinbase_merkle_root(mCoinbase, 1, mMiner.merkle_result);
+
+    #ifdef DEBUG_MINING
+    Serial.print("    extranonce2: "); Serial.println(mWorker.extranonce2);
+    #endif
+
+    Serial.print("    merkle sha         : ");
+    for (int i = 0; i < 32; i++)
+      Serial.printf("%02x", mMiner.merkle_result[i]);
+    Serial.println("");
 
+    // block header, every field little endian: version, prevhash, merkle root, ntime, nbits, nonce
+    uint8_t *header = mMiner.bytearray_blockheader;
+    ((uint32_t*)header)[0] = mJob.version;
+    memcpy(header + 4, mJob.prev_block_hash, 32);
+    memcpy(header + 36, mMiner.merkle_result, 32);
+    ((uint32_t*)header)[17] = mJob.ntime;
+    ((uint32_t*)header)[18] = mJob.nbits;
+    ((uint32_t*)header)[19] = 0;
 
     #ifdef DEBUG_MINING
     Serial.print(" >>> bytearray_blockheader     : "); 
@@ -424,7 +338,7 @@ miner_data calculateMiningData(mining_subscribe& mWorker, mining_job mJob){
         Serial.printf("%02x", mMiner.bytearray_blockheader[i]);
     Serial.println("");
     Serial.println("bytearray_blockheader: ");
-    for (size_t i = 0; i < str_len; i++) {
+    for (size_t i = 0; i < 80; i++) {
       Serial.printf("%02x", mMiner.bytearray_blockheader[i]);
     }
     Serial.println("");
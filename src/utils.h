@@ -5,6 +5,8 @@
 #include <stdint.h>
 #include "mining.h"
 #include "stratum.h"
+#include "uint256.h"
+#include "ShaTests/nerdSHA256plus.h"
 
 /*
  * General byte order swapping functions.
@@ -15,13 +17,32 @@
 
 
 
+#define COINBASE_TAIL_SIZE        STRATUM_COINB2_MAX
+#define COINBASE_EXTRANONCE2_MAX  8
+
+/*
+ * Per job coinbase, coinb1+extranonce1 already hashed so a new extranonce2 only
+ * costs the tail (extranonce2+coinb2) and the merkle fold
+ */
+typedef struct {
+  nerdSHA256_stream prefix;
+  uint8_t coinb2[COINBASE_TAIL_SIZE];
+  size_t coinb2_size;
+  uint8_t merkle_branch[MAX_MERKLE_BRANCHES][32];
+  size_t merkle_count;
+  int extranonce2_size;
+} coinbase_midstate;
+
 uint8_t hex(char ch);
 
 int to_byte_array(const char *in, size_t in_size, uint8_t *out);
 double le256todouble(const void *target);
 double diff_from_target(void *target);
 bool isSha256Valid(const void* sha256);
-miner_data calculateMiningData(mining_subscribe& mWorker, mining_job mJob);
+miner_data calculateMiningData(mining_subscribe& mWorker, const mining_job& mJob, coinbase_midstate& mCoinbase);
+bool coinbase_midstate_init(coinbase_midstate& mCoinbase, mining_subscribe& mWorker, const mining_job& mJob);
+void coinbase_merkle_root(const coinbase_midstate& mCoinbase, uint64_t extranonce2, uint8_t *merkle_root);
+void extranonce2_to_hex(uint64_t extranonce2, int extranonce2_size, char *extranonce2_char);
 bool checkValid(unsigned char* hash, unsigned char* target);
 void suffix_string(double val, char *buf, size_t bufsiz, int sigdigits);
 
@@ -0,0 +1,105 @@
+#include <unity.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "test_utils.h"
+
+// Only compile this for native tests
+#ifdef NATIVE_TEST
+
+#include <thread>
+#include <vector>
+#include "../src/job_ring.h"
+
+struct TestJob {
+    uint32_t id;
+    uint8_t payload[128];
+};
+
+//=============================================================================
+// JOB RING TESTS
+//=============================================================================
+
+// Test FIFO order, full and empty, across several wraps of the indexes
+void test_job_ring_fifo(void) {
+    static JobRing<TestJob, 8> ring;
+    TestJob job;
+    uint32_t next_in = 0;
+    uint32_t next_out = 0;
+
+    TEST_ASSERT_FALSE(ring.pop(job));
+
+    for (int round = 0; round < 10; round++) {
+        while (true) {
+            job.id = next_in;
+            memset(job.payload, next_in & 0xFF, sizeof(job.payload));
+            if (!ring.push(job))
+                break;
+            next_in++;
+        }
+        TEST_ASSERT_EQUAL_UINT32(8, ring.size());
+
+        // Drain half so head and tail wrap at different points
+        for (int i = 0; i < 5; i++) {
+            TEST_ASSERT_TRUE(ring.pop(job));
+            TEST_ASSERT_EQUAL_UINT32(next_out, job.id);
+            TEST_ASSERT_EQUAL_UINT8(next_out & 0xFF, job.payload[127]);
+            next_out++;
+        }
+    }
+
+    ring.clear();
+    TEST_ASSERT_EQUAL_UINT32(0, ring.size());
+    TEST_ASSERT_FALSE(ring.pop(job));
+}
+
+// Test several producers and consumers, every value comes out exactly once
+void test_job_ring_concurrent(void) {
+    static JobRing<TestJob, 16> ring;
+    const uint32_t producers = 2;
+    const uint32_t consumers = 3;
+    const uint32_t per_producer = 20000;
+    static uint8_t seen[2 * 20000];
+    memset(seen, 0, sizeof(seen));
+
+    std::vector<std::thread> threads;
+    for (uint32_t p = 0; p < producers; p++) {
+        threads.push_back(std::thread([p, per_producer]() {
+            TestJob job;
+            for (uint32_t i = 0; i < per_producer; i++) {
+                job.id = p * per_producer + i;
+                memset(job.payload, job.id & 0xFF, sizeof(job.payload));
+                while (!ring.push(job))
+                    std::this_thread::yield();
+            }
+        }));
+    }
+
+    std::atomic<uint32_t> consumed(0);
+    std::atomic<uint32_t> torn(0);
+    for (uint32_t c = 0; c < consumers; c++) {
+        threads.push_back(std::thread([&consumed, &torn, producers, per_producer]() {
+            TestJob job;
+            while (consumed.load() < producers * per_producer) {
+                if (!ring.pop(job)) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                if (job.payload[0] != (job.id & 0xFF) || job.payload[127] != (job.id & 0xFF))
+                    torn++;
+                seen[job.id]++;
+                consumed++;
+            }
+        }));
+    }
+
+    for (size_t t = 0; t < threads.size(); t++)
+        threads[t].join();
+
+    TEST_ASSERT_EQUAL_UINT32(0, torn.load());
+    for (uint32_t i = 0; i < producers * per_producer; i++)
+        TEST_ASSERT_EQUAL_UINT8(1, seen[i]);
+    TEST_ASSERT_EQUAL_UINT32(0, ring.size());
+}
+
+#endif // NATIVE_TEST
@@ -0,0 +1,93 @@
+#include <unity.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "test_utils.h"
+
+// Only compile this for native tests
+#ifdef NATIVE_TEST
+
+#include "../src/line_reader.h"
+
+// Feeds text in pieces of at most chunk bytes, like partial socket reads
+template <uint32_t N>
+static uint32_t test_line_reader_feed(LineReader<N>& reader, const char* text, uint32_t chunk) {
+    uint32_t space;
+    char* at = reader.space(space);
+    uint32_t len = strlen(text);
+    if (len > chunk) len = chunk;
+    if (len > space) len = space;
+    memcpy(at, text, len);
+    reader.commit(len);
+    return len;
+}
+
+//=============================================================================
+// LINE READER TESTS
+//=============================================================================
+
+// Test lines split across reads, CRLF endings and empty lines
+void test_line_reader_framing(void) {
+    static LineReader<64> reader;
+    const char* stream = "{\"id\":1}\r\n\n{\"method\":\"mining.notify\"}\n{\"id\":";
+    const char* expected[] = { "{\"id\":1}", "", "{\"method\":\"mining.notify\"}" };
+    const char* line;
+    uint32_t len;
+    uint32_t found = 0;
+
+    TEST_ASSERT_FALSE(reader.next(line, len));
+
+    // Three bytes at a time, every line boundary lands in a different place of a read
+    uint32_t fed = 0;
+    while (stream[fed] != '\0') {
+        fed += test_line_reader_feed(reader, stream + fed, 3);
+        while (reader.next(line, len)) {
+            TEST_ASSERT_TRUE(found < 3);
+            TEST_ASSERT_EQUAL_UINT32(strlen(expected[found]), len);
+            TEST_ASSERT_EQUAL_STRING(expected[found], line);
+            found++;
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT32(3, found);
+
+    // The partial message stays buffered until its end arrives
+    TEST_ASSERT_EQUAL_UINT32(6, reader.size());
+    test_line_reader_feed(reader, "7}\n", 16);
+    TEST_ASSERT_TRUE(reader.next(line, len));
+    TEST_ASSERT_EQUAL_STRING("{\"id\":7}", line);
+    TEST_ASSERT_EQUAL_UINT32(0, reader.size());
+    TEST_ASSERT_EQUAL_UINT32(0, reader.dropped());
+}
+
+// Test a line longer than the buffer is dropped and the next ones still come out
+void test_line_reader_overflow(void) {
+    static LineReader<16> reader;
+    const char* stream = "abc\n0123456789ABCDEFGHIJ\nok\n";
+    const char* expected[] = { "abc", "ok" };
+    const char* line;
+    uint32_t len;
+    uint32_t found = 0;
+
+    TEST_ASSERT_EQUAL_UINT32(15, reader.capacity());
+    uint32_t fed = 0;
+    while (stream[fed] != '\0') {
+        fed += test_line_reader_feed(reader, stream + fed, 64);
+        while (reader.next(line, len)) {
+            TEST_ASSERT_TRUE(found < 2);
+            TEST_ASSERT_EQUAL_UINT32(strlen(expected[found]), len);
+            TEST_ASSERT_EQUAL_STRING(expected[found], line);
+            found++;
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT32(2, found);
+    TEST_ASSERT_EQUAL_UINT32(1, reader.dropped());
+
+    // A new connection starts clean
+    test_line_reader_feed(reader, "half", 64);
+    reader.clear();
+    test_line_reader_feed(reader, "new\n", 64);
+    TEST_ASSERT_TRUE(reader.next(line, len));
+    TEST_ASSERT_EQUAL_STRING("new", line);
+}
+
+#endif // NATIVE_TEST
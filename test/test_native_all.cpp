@@ -454,6 +454,46 @@ extern void test_subscribe_structure(void);
 extern void test_message_size_limits(void);
 extern void test_error_codes(void);
 
+extern void test_nerd_sha256d_baked_genesis(void);
+extern void test_nerd_sha256d_baked_early_reject(void);
+extern void test_nerd_sha256d_baked_xN_matches_scalar(void);
+extern void test_nerd_sha256d_baked_x2_matches_scalar(void);
+extern void test_nerd_sha256d_deepbaked_matches_baked(void);
+extern void test_nerd_sha256d_engine_full_hash(void);
+extern void test_nerd_sha256d_engine_matches_kernels(void);
+extern void test_nerd_sha256d_64(void);
+extern void test_nerd_sha256d_64_merkle_fold(void);
+extern void test_nerd_sha256_stream(void);
+extern void test_nerd_sha256_stream_prefix(void);
+
+extern void test_uint256_diff1_target(void);
+extern void test_uint256_from_nbits(void);
+extern void test_uint256_hash_below_edges(void);
+extern void test_uint256_matches_float_difficulty(void);
+
+// Job Ring Tests
+extern void test_job_ring_fifo(void);
+extern void test_job_ring_concurrent(void);
+
+// Line Reader Tests
+extern void test_line_reader_framing(void);
+extern void test_line_reader_overflow(void);
+
+// Stratum Notify Decoder Tests
+extern void test_stratum_notify_decode_fields(void);
+extern void test_stratum_notify_decode_layout(void);
+extern void test_stratum_notify_decode_rejects(void);
+extern void test_stratum_notify_job_queue(void);
+
+// Stratum Submit Template Tests
+extern void test_stratum_submit_encode(void);
+extern void test_stratum_submit_layout(void);
+extern void test_stratum_submit_rejects(void);
+
+// Submit Tracker Tests
+extern void test_submit_tracker_answers(void);
+extern void test_submit_tracker_lost(void);
+
 int main(int argc, char **argv) {
     UNITY_BEGIN();
 
@@ -504,6 +544,48 @@ int main(int argc, char **argv) {
     RUN_TEST(test_message_size_limits);
     RUN_TEST(test_error_codes);
 
+    // Nerd SHA256d Kernel Tests
+    RUN_TEST(test_nerd_sha256d_baked_genesis);
+    RUN_TEST(test_nerd_sha256d_baked_early_reject);
+    RUN_TEST(test_nerd_sha256d_baked_xN_matches_scalar);
+    RUN_TEST(test_nerd_sha256d_baked_x2_matches_scalar);
+    RUN_TEST(test_nerd_sha256d_deepbaked_matches_baked);
+    RUN_TEST(test_nerd_sha256d_engine_full_hash);
+    RUN_TEST(test_nerd_sha256d_engine_matches_kernels);
+    RUN_TEST(test_nerd_sha256d_64);
+    RUN_TEST(test_nerd_sha256d_64_merkle_fold);
+    RUN_TEST(test_nerd_sha256_stream);
+    RUN_TEST(test_nerd_sha256_stream_prefix);
+
+    // Integer Target Tests
+    RUN_TEST(test_uint256_diff1_target);
+    RUN_TEST(test_uint256_from_nbits);
+    RUN_TEST(test_uint256_hash_below_edges);
+    RUN_TEST(test_uint256_matches_float_difficulty);
+
+    // Job Ring Tests
+    RUN_TEST(test_job_ring_fifo);
+    RUN_TEST(test_job_ring_concurrent);
+
+    // Line Reader Tests
+    RUN_TEST(test_line_reader_framing);
+    RUN_TEST(test_line_reader_overflow);
+
+    // Stratum Notify Decoder Tests
+    RUN_TEST(test_stratum_notify_decode_fields);
+    RUN_TEST(test_stratum_notify_decode_layout);
+    RUN_TEST(test_stratum_notify_decode_rejects);
+    RUN_TEST(test_stratum_notify_job_queue);
+
+    // Stratum Submit Template Tests
+    RUN_TEST(test_stratum_submit_encode);
+    RUN_TEST(test_stratum_submit_layout);
+    RUN_TEST(test_stratum_submit_rejects);
+
+    // Submit Tracker Tests
+    RUN_TEST(test_submit_tracker_answers);
+    RUN_TEST(test_submit_tracker_lost);
+
     return UNITY_END();
 }
 
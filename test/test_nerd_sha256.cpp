@@ -0,0 +1,395 @@
+#include <unity.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "test_utils.h"
+#include "fixtures/sha256_test_vectors.h"
+#include "fixtures/mining_test_vectors.h"
+
+// Only compile this for native tests
+#ifdef NATIVE_TEST
+
+#include "../src/ShaTests/nerdSHA256plus.h"
+
+// External SHA256 implementation from test_native_all.cpp
+extern void reference_sha256_double(const uint8_t* input, size_t input_len, uint8_t* output);
+
+// Genesis block nonce (0x7c2bac1d), stored little endian at header offset 76
+#define GENESIS_NONCE 2083236893U
+
+// Build the padded header, midstate and bake the same way mining.cpp does
+static void prepare_baked_header(const uint8_t* header, uint32_t nonce, uint8_t* sha_buffer, uint32_t* midstate, uint32_t* bake) {
+    memset(sha_buffer, 0, 128);
+    memcpy(sha_buffer, header, 80);
+    memcpy(sha_buffer + 76, &nonce, 4);
+    sha_buffer[80] = 0x80;
+    sha_buffer[126] = 0x02;
+    sha_buffer[127] = 0x80;
+
+    nerd_mids(midstate, sha_buffer);
+    nerd_sha256_bake(midstate, sha_buffer + 64, bake);
+}
+
+//=============================================================================
+// NERD SHA256D KERNEL TESTS
+//=============================================================================
+
+// Test the scalar baked kernel finds the genesis block hash
+void test_nerd_sha256d_baked_genesis(void) {
+    uint8_t sha_buffer[128];
+    uint32_t midstate[8];
+    uint32_t bake[16];
+    uint8_t hash[32];
+    uint8_t expected[32];
+
+    prepare_baked_header(BITCOIN_BLOCK_HEADER_TV1, GENESIS_NONCE, sha_buffer, midstate, bake);
+    reference_sha256_double(BITCOIN_BLOCK_HEADER_TV1, 80, expected);
+
+    TEST_ASSERT_TRUE(nerd_sha256d_baked(midstate, sha_buffer + 64, bake, hash));
+    TEST_ASSERT_EQUAL_MEMORY(expected, hash, 32);
+}
+
+// Test the scalar early reject agrees with the reference implementation around the genesis nonce
+void test_nerd_sha256d_baked_early_reject(void) {
+    uint8_t sha_buffer[128];
+    uint32_t midstate[8];
+    uint32_t bake[16];
+    uint8_t header[80];
+    uint8_t hash[32];
+    uint8_t expected[32];
+
+    memcpy(header, BITCOIN_BLOCK_HEADER_TV1, 80);
+    prepare_baked_header(header, GENESIS_NONCE - 256, sha_buffer, midstate, bake);
+
+    for (uint32_t nonce = GENESIS_NONCE - 256; nonce < GENESIS_NONCE + 256; nonce++) {
+        memcpy(sha_buffer + 76, &nonce, 4);
+        memcpy(header + 76, &nonce, 4);
+        reference_sha256_double(header, 80, expected);
+
+        bool hit = nerd_sha256d_baked(midstate, sha_buffer + 64, bake, hash);
+        TEST_ASSERT_EQUAL(expected[31] == 0 && expected[30] == 0, hit);
+        if (hit)
+            TEST_ASSERT_EQUAL_MEMORY(expected, hash, 32);
+    }
+}
+
+// Test the multi lane kernel reports the same lanes and hashes as the scalar kernel
+void test_nerd_sha256d_baked_xN_matches_scalar(void) {
+    uint8_t sha_buffer[128];
+    uint32_t midstate[8];
+    uint32_t bake[16];
+    uint8_t hash[32];
+    uint8_t lane_hashes[NERD_SHA256D_MAX_LANES * 32];
+
+    uint32_t lanes = nerd_sha256d_lanes();
+    TEST_ASSERT_TRUE(lanes >= 1 && lanes <= NERD_SHA256D_MAX_LANES);
+
+    // Start a bit below genesis so the hit lands in the middle of a lane group
+    uint32_t start = GENESIS_NONCE - 3 * lanes - 1;
+    prepare_baked_header(BITCOIN_BLOCK_HEADER_TV1, start, sha_buffer, midstate, bake);
+
+    uint32_t hits = 0;
+    for (uint32_t nonce = start; nonce < start + (1 << 18); nonce += lanes) {
+        memcpy(sha_buffer + 76, &nonce, 4);
+        uint32_t mask = nerd_sha256d_baked_xN(midstate, sha_buffer + 64, bake, lane_hashes);
+
+        for (uint32_t i = 0; i < lanes; i++) {
+            uint32_t lane_nonce = nonce + i;
+            memcpy(sha_buffer + 76, &lane_nonce, 4);
+            bool hit = nerd_sha256d_baked(midstate, sha_buffer + 64, bake, hash);
+            TEST_ASSERT_EQUAL(hit, (mask >> i) & 1);
+            if (hit) {
+                TEST_ASSERT_EQUAL_MEMORY(hash, lane_hashes + 32 * i, 32);
+                hits++;
+            }
+        }
+        TEST_ASSERT_EQUAL(0, mask >> lanes);
+    }
+
+    // Genesis nonce alone must hit
+    TEST_ASSERT_TRUE(hits >= 1);
+}
+
+// Test the two way interleaved kernel against the scalar kernel
+void test_nerd_sha256d_baked_x2_matches_scalar(void) {
+    uint8_t sha_buffer[128];
+    uint32_t midstate[8];
+    uint32_t bake[16];
+    uint8_t hash[32];
+    uint8_t pair_hashes[64];
+
+    // Odd start puts the genesis nonce in the second slot
+    uint32_t start = GENESIS_NONCE - 1 - 2 * 1000;
+    prepare_baked_header(BITCOIN_BLOCK_HEADER_TV1, start, sha_buffer, midstate, bake);
+
+    uint32_t hits = 0;
+    for (uint32_t nonce = start; nonce < start + (1 << 17); nonce += 2) {
+        memcpy(sha_buffer + 76, &nonce, 4);
+        uint32_t mask = nerd_sha256d_baked_x2(midstate, sha_buffer + 64, bake, pair_hashes);
+
+        for (uint32_t i = 0; i < 2; i++) {
+            uint32_t lane_nonce = nonce + i;
+            memcpy(sha_buffer + 76, &lane_nonce, 4);
+            bool hit = nerd_sha256d_baked(midstate, sha_buffer + 64, bake, hash);
+            TEST_ASSERT_EQUAL(hit, (mask >> i) & 1);
+            if (hit) {
+                TEST_ASSERT_EQUAL_MEMORY(hash, pair_hashes + 32 * i, 32);
+                hits++;
+            }
+        }
+        TEST_ASSERT_EQUAL(0, mask >> 2);
+    }
+
+    TEST_ASSERT_TRUE(hits >= 1);
+}
+
+// Assemble an 80 byte header from the fields of a mining job test vector
+static void header_from_job(const struct test_mining_job* job, uint8_t* header) {
+    uint32_t value;
+    memset(header, 0, 80);
+    hex_string_to_bytes(job->version, header, 4);
+    hex_string_to_bytes(job->prev_block_hash, header + 4, 32);
+    hex_string_to_bytes(job->merkle_branches[0], header + 36, 32);
+    value = (uint32_t)strtoul(job->ntime, NULL, 16);
+    memcpy(header + 68, &value, 4);
+    value = (uint32_t)strtoul(job->nbits, NULL, 16);
+    memcpy(header + 72, &value, 4);
+}
+
+// Compare the deep baked kernel with the baked one over count nonces, returns the number of hits
+static uint32_t compare_deepbaked(const uint8_t* header, uint32_t start, uint32_t count) {
+    uint8_t sha_buffer[128];
+    uint32_t midstate[8];
+    uint32_t bake[16];
+    uint32_t deepbake[NERD_DEEPBAKE_WORDS];
+    uint8_t hash[32];
+    uint8_t deep_hash[32];
+
+    prepare_baked_header(header, start, sha_buffer, midstate, bake);
+    nerd_sha256_deepbake(midstate, sha_buffer + 64, deepbake);
+    TEST_ASSERT_EQUAL_MEMORY(bake, deepbake, 15 * sizeof(uint32_t));
+
+    uint32_t hits = 0;
+    for (uint32_t n = 0; n < count; n++) {
+        uint32_t nonce = start + n;
+        memcpy(sha_buffer + 76, &nonce, 4);
+        bool hit = nerd_sha256d_baked(midstate, sha_buffer + 64, bake, hash);
+        bool deep_hit = nerd_sha256d_deepbaked(midstate, sha_buffer + 64, deepbake, deep_hash);
+        TEST_ASSERT_EQUAL(hit, deep_hit);
+        if (hit) {
+            TEST_ASSERT_EQUAL_MEMORY(hash, deep_hash, 32);
+            hits++;
+        }
+    }
+    return hits;
+}
+
+// Test the deep baked kernel matches the baked kernel for every mining test vector
+void test_nerd_sha256d_deepbaked_matches_baked(void) {
+    const uint32_t nonces[] = { TEST_NONCE_1, TEST_NONCE_2, TEST_NONCE_3, TEST_NONCE_ZERO, TEST_NONCE_MAX,
+                                NONCE_RANGE_TEST_START, NONCE_RANGE_TEST_END, GENESIS_NONCE };
+    uint8_t headers[3][80];
+
+    memcpy(headers[0], TEST_BLOCK_HEADER_TEMPLATE, 80);
+    header_from_job(&TEST_MINING_JOB_1, headers[1]);
+    header_from_job(&TEST_MINING_JOB_2, headers[2]);
+
+    for (int h = 0; h < 3; h++) {
+        // Window around each test nonce, TEST_NONCE_MAX wraps to zero
+        for (size_t i = 0; i < sizeof(nonces) / sizeof(nonces[0]); i++)
+            compare_deepbaked(headers[h], nonces[i] - 1024, 2048);
+
+        // Long sweep so the post early reject path is exercised on every header
+        TEST_ASSERT_TRUE(compare_deepbaked(headers[h], NONCE_RANGE_TEST_START, 1 << 18) >= 1);
+    }
+
+    // Genesis nonce must hit
+    TEST_ASSERT_TRUE(compare_deepbaked(TEST_BLOCK_HEADER_TEMPLATE, GENESIS_NONCE, 1) == 1);
+}
+
+// Test the full hash engine variants against the reference implementation
+void test_nerd_sha256d_engine_full_hash(void) {
+    uint8_t sha_buffer[128];
+    uint32_t midstate[8];
+    uint32_t bake[16];
+    uint8_t header[80];
+    uint8_t hash[32];
+    uint8_t expected[32];
+    uint32_t words[8];
+
+    memcpy(header, BITCOIN_BLOCK_HEADER_TV1, 80);
+    prepare_baked_header(header, TEST_NONCE_1, sha_buffer, midstate, bake);
+
+    for (uint32_t nonce = TEST_NONCE_1; nonce < TEST_NONCE_1 + 64; nonce++) {
+        memcpy(header + 76, &nonce, 4);
+        memcpy(sha_buffer + 76, &nonce, 4);
+        reference_sha256_double(header, 80, expected);
+
+        TEST_ASSERT_TRUE((nerd_sha256d_engine<0, 0, 1>(midstate, sha_buffer + 64, NULL, hash)));
+        TEST_ASSERT_EQUAL_MEMORY(expected, hash, 32);
+
+        TEST_ASSERT_TRUE((nerd_sha256d_engine<3, 0, 1>(midstate, sha_buffer + 64, bake, hash)));
+        TEST_ASSERT_EQUAL_MEMORY(expected, hash, 32);
+
+        // Native words are the big endian hash words before the byte swap
+        TEST_ASSERT_TRUE((nerd_sha256d_engine<3, 0, 0>(midstate, sha_buffer + 64, bake, (uint8_t*)words)));
+        for (int i = 0; i < 8; i++) {
+            uint32_t be = ((uint32_t)expected[4 * i] << 24) | ((uint32_t)expected[4 * i + 1] << 16) |
+                          ((uint32_t)expected[4 * i + 2] << 8) | expected[4 * i + 3];
+            TEST_ASSERT_EQUAL_HEX32(be, words[i]);
+        }
+    }
+}
+
+// Test the early exit kernels and engine variants hit exactly the hashes ending in 16 zero bits
+void test_nerd_sha256d_engine_matches_kernels(void) {
+    uint8_t sha_buffer[128];
+    uint32_t midstate[8];
+    uint32_t bake[16];
+    uint8_t header[80];
+    uint8_t expected[32];
+    uint8_t hash[32];
+    uint8_t engine_hash[32];
+    nerdSHA256_context ctx;
+
+    uint32_t start = GENESIS_NONCE - (1 << 16);
+    memcpy(header, BITCOIN_BLOCK_HEADER_TV1, 80);
+    prepare_baked_header(header, start, sha_buffer, midstate, bake);
+    memcpy(ctx.digest, midstate, sizeof(midstate));
+
+    uint32_t hits = 0;
+    for (uint32_t nonce = start; nonce < start + (1 << 17); nonce++) {
+        memcpy(sha_buffer + 76, &nonce, 4);
+        memcpy(header + 76, &nonce, 4);
+        reference_sha256_double(header, 80, expected);
+        bool hit = expected[30] == 0 && expected[31] == 0;
+
+        TEST_ASSERT_EQUAL(hit, nerd_sha256d_baked(midstate, sha_buffer + 64, bake, hash));
+        TEST_ASSERT_EQUAL(hit, (nerd_sha256d_engine<3, 60, 1>(midstate, sha_buffer + 64, bake, engine_hash)));
+        if (hit) {
+            TEST_ASSERT_EQUAL_MEMORY(expected, hash, 32);
+            TEST_ASSERT_EQUAL_MEMORY(expected, engine_hash, 32);
+            hits++;
+        }
+
+        TEST_ASSERT_EQUAL(hit, nerd_sha256d(&ctx, sha_buffer + 64, hash));
+        TEST_ASSERT_EQUAL(hit, (nerd_sha256d_engine<0, 60, 1>(midstate, sha_buffer + 64, NULL, engine_hash)));
+        if (hit) {
+            TEST_ASSERT_EQUAL_MEMORY(expected, hash, 32);
+            TEST_ASSERT_EQUAL_MEMORY(expected, engine_hash, 32);
+        }
+    }
+
+    TEST_ASSERT_TRUE(hits >= 1);
+}
+
+// Test the 64 byte kernel against the reference on random merkle nodes
+void test_nerd_sha256d_64(void) {
+    uint8_t nodes[8 * 64];
+    uint8_t hashes[8 * 32];
+    uint8_t expected[32];
+    uint32_t seed = 0xCAFEBABE;
+
+    for (size_t i = 0; i < sizeof(nodes); i++) {
+        seed = seed * 1664525 + 1013904223;
+        nodes[i] = seed >> 24;
+    }
+
+    for (int n = 0; n < 8; n++) {
+        reference_sha256_double(nodes + 64 * n, 64, expected);
+        nerd_sha256d_64(nodes + 64 * n, hashes);
+        TEST_ASSERT_EQUAL_MEMORY(expected, hashes, 32);
+    }
+
+    nerd_sha256d_64_batch(nodes, hashes, 8);
+    for (int n = 0; n < 8; n++) {
+        reference_sha256_double(nodes + 64 * n, 64, expected);
+        TEST_ASSERT_EQUAL_MEMORY(expected, hashes + 32 * n, 32);
+    }
+}
+
+// Test folding the merkle branches of the mining job vectors like calculateMiningData()
+void test_nerd_sha256d_64_merkle_fold(void) {
+    const struct test_mining_job* jobs[] = { &TEST_MINING_JOB_1, &TEST_MINING_JOB_2 };
+
+    for (int j = 0; j < 2; j++) {
+        uint8_t root[32];
+        uint8_t expected[32];
+        uint8_t node[64];
+
+        // Any 32 bytes do as the coinbase hash here
+        reference_sha256_double((const uint8_t*)jobs[j]->coinb1, strlen(jobs[j]->coinb1), root);
+        memcpy(expected, root, 32);
+
+        for (int k = 0; k < jobs[j]->merkle_branch_count; k++) {
+            uint8_t branch[32];
+            hex_string_to_bytes(jobs[j]->merkle_branches[k], branch, 32);
+
+            memcpy(node, expected, 32);
+            memcpy(node + 32, branch, 32);
+            reference_sha256_double(node, 64, expected);
+
+            memcpy(node, root, 32);
+            memcpy(node + 32, branch, 32);
+            nerd_sha256d_64(node, root);
+        }
+        TEST_ASSERT_EQUAL_MEMORY(expected, root, 32);
+    }
+}
+
+// Test the streaming sha256d against the reference for lengths around the block and padding edges
+void test_nerd_sha256_stream(void) {
+    uint8_t data[300];
+    uint8_t hash[32];
+    uint8_t expected[32];
+    uint32_t seed = 0x0BADF00D;
+
+    for (size_t i = 0; i < sizeof(data); i++) {
+        seed = seed * 1664525 + 1013904223;
+        data[i] = seed >> 24;
+    }
+
+    for (size_t len = 0; len <= sizeof(data); len++) {
+        nerdSHA256_stream ctx;
+        nerd_sha256_start(&ctx);
+        // Uneven pieces so partial blocks get buffered
+        for (size_t off = 0; off < len; off += 7)
+            nerd_sha256_update(&ctx, data + off, len - off < 7 ? len - off : 7);
+        nerd_sha256d_finish(&ctx, hash);
+
+        reference_sha256_double(data, len, expected);
+        TEST_ASSERT_EQUAL_MEMORY(expected, hash, 32);
+    }
+}
+
+// Test a copied prefix context finished with different tails, like the coinbase midstate cache
+void test_nerd_sha256_stream_prefix(void) {
+    const struct test_mining_job* job = &TEST_MINING_JOB_2;
+    uint8_t coinbase[256];
+    uint8_t hash[32];
+    uint8_t expected[32];
+
+    size_t coinb1_len = strlen(job->coinb1) / 2;
+    size_t coinb2_len = strlen(job->coinb2) / 2;
+    size_t extranonce2_at = coinb1_len + 4;
+    hex_string_to_bytes(job->coinb1, coinbase, coinb1_len);
+    hex_string_to_bytes("f0000000", coinbase + coinb1_len, 4);
+    hex_string_to_bytes(job->coinb2, coinbase + extranonce2_at + 4, coinb2_len);
+
+    nerdSHA256_stream prefix;
+    nerd_sha256_start(&prefix);
+    nerd_sha256_update(&prefix, coinbase, extranonce2_at);
+
+    for (uint32_t extranonce2 = 0; extranonce2 < 16; extranonce2++) {
+        coinbase[extranonce2_at + 3] = extranonce2;
+
+        nerdSHA256_stream ctx = prefix;
+        nerd_sha256_update(&ctx, coinbase + extranonce2_at, 4 + coinb2_len);
+        nerd_sha256d_finish(&ctx, hash);
+
+        reference_sha256_double(coinbase, extranonce2_at + 4 + coinb2_len, expected);
+        TEST_ASSERT_EQUAL_MEMORY(expected, hash, 32);
+    }
+}
+
+#endif // NATIVE_TEST
@@ -9,6 +9,7 @@
 #include "test_utils.h"
 #include "fixtures/mining_test_vectors.h"
 #include "fixtures/sha256_test_vectors.h"
+#include "../src/ShaTests/nerdSHA256plus.h"
 
 // Board-specific includes - using TFT_eSPI built-in touch instead of ETOUCH
 // TFT_eSPI supports touch functionality natively
@@ -180,6 +181,129 @@ void test_sha256_double_hash_benchmark(void) {
     Serial.println("SHA256 double hash benchmark passed");
 }
 
+// A/B benchmark of the single nonce miner kernel against the template engine, interleaved and deep baked ones
+void test_nerd_sha256d_interleaved_benchmark(void) {
+    Serial.println("=== nerd_sha256d_baked vs engine vs x2 vs deepbaked Benchmark ===");
+
+    const uint32_t nonces = 16 * 1024;
+    uint8_t sha_buffer[128];
+    uint32_t midstate[8];
+    uint32_t bake[16];
+    uint8_t hash[64];
+
+    // Padded header and bake, same as the miner jobs
+    memset(sha_buffer, 0, sizeof(sha_buffer));
+    memcpy(sha_buffer, BITCOIN_BLOCK_HEADER_TV1, 80);
+    sha_buffer[80] = 0x80;
+    sha_buffer[126] = 0x02;
+    sha_buffer[127] = 0x80;
+    nerd_mids(midstate, sha_buffer);
+    nerd_sha256_bake(midstate, sha_buffer + 64, bake);
+
+    // Range holds the genesis nonce so both kernels must find it
+    uint32_t start = 0x7c2bac1d - nonces / 2;
+
+    uint32_t hits_single = 0;
+    uint32_t start_time = micros();
+    for (uint32_t n = 0; n < nonces; n++) {
+        ((uint32_t*)(sha_buffer + 64 + 12))[0] = start + n;
+        if (nerd_sha256d_baked(midstate, sha_buffer + 64, bake, hash))
+            hits_single++;
+    }
+    uint32_t time_single = micros() - start_time;
+
+    uint32_t hits_engine = 0;
+    start_time = micros();
+    for (uint32_t n = 0; n < nonces; n++) {
+        ((uint32_t*)(sha_buffer + 64 + 12))[0] = start + n;
+        if (nerd_sha256d_engine<3, 60, 1>(midstate, sha_buffer + 64, bake, hash))
+            hits_engine++;
+    }
+    uint32_t time_engine = micros() - start_time;
+
+    uint32_t hits_x2 = 0;
+    start_time = micros();
+    for (uint32_t n = 0; n < nonces; n += 2) {
+        ((uint32_t*)(sha_buffer + 64 + 12))[0] = start + n;
+        hits_x2 += __builtin_popcount(nerd_sha256d_baked_x2(midstate, sha_buffer + 64, bake, hash));
+    }
+    uint32_t time_x2 = micros() - start_time;
+
+    uint32_t deepbake[NERD_DEEPBAKE_WORDS];
+    nerd_sha256_deepbake(midstate, sha_buffer + 64, deepbake);
+    uint32_t hits_deep = 0;
+    start_time = micros();
+    for (uint32_t n = 0; n < nonces; n++) {
+        ((uint32_t*)(sha_buffer + 64 + 12))[0] = start + n;
+        if (nerd_sha256d_deepbaked(midstate, sha_buffer + 64, deepbake, hash))
+            hits_deep++;
+    }
+    uint32_t time_deep = micros() - start_time;
+
+    float rate_single = (float)nonces / (float)time_single * 1000000.0f;
+    float rate_engine = (float)nonces / (float)time_engine * 1000000.0f;
+    float rate_x2 = (float)nonces / (float)time_x2 * 1000000.0f;
+    float rate_deep = (float)nonces / (float)time_deep * 1000000.0f;
+    Serial.printf("Single nonce: %u hashes in %u µs, %.2f KH/s\n", nonces, time_single, rate_single / 1000.0f);
+    Serial.printf("Template engine: %u hashes in %u µs, %.2f KH/s\n", nonces, time_engine, rate_engine / 1000.0f);
+    Serial.printf("Interleaved x2: %u hashes in %u µs, %.2f KH/s\n", nonces, time_x2, rate_x2 / 1000.0f);
+    Serial.printf("Deep baked: %u hashes in %u µs, %.2f KH/s\n", nonces, time_deep, rate_deep / 1000.0f);
+    Serial.printf("Speedup engine: %.2fx, x2: %.2fx, deep baked: %.2fx\n", rate_engine / rate_single, rate_x2 / rate_single, rate_deep / rate_single);
+    Serial.println();
+
+    TEST_ASSERT_TRUE(hits_single >= 1);
+    TEST_ASSERT_EQUAL(hits_single, hits_engine);
+    TEST_ASSERT_EQUAL(hits_single, hits_x2);
+    TEST_ASSERT_EQUAL(hits_single, hits_deep);
+
+    Serial.println("nerd_sha256d interleaved benchmark passed");
+}
+
+// Merkle node hashing, mbedtls (old calculateMiningData path) vs nerd_sha256d_64
+void test_merkle_node_benchmark(void) {
+    Serial.println("=== Merkle Node sha256d Benchmark ===");
+
+    const uint32_t iterations = 1000;
+    uint8_t node[64];
+    uint8_t inter[32];
+    uint8_t mbed_hash[32];
+    uint8_t nerd_hash[32];
+
+    memcpy(node, BITCOIN_BLOCK_HEADER_TV1, 64);
+
+    uint32_t start_time = micros();
+    for (uint32_t i = 0; i < iterations; i++) {
+        node[0] = i;
+        mbedtls_sha256_context ctx;
+        mbedtls_sha256_init(&ctx);
+        mbedtls_sha256_starts(&ctx, 0);
+        mbedtls_sha256_update(&ctx, node, 64);
+        mbedtls_sha256_finish(&ctx, inter);
+        mbedtls_sha256_starts(&ctx, 0);
+        mbedtls_sha256_update(&ctx, inter, 32);
+        mbedtls_sha256_finish(&ctx, mbed_hash);
+        mbedtls_sha256_free(&ctx);
+    }
+    uint32_t time_mbed = micros() - start_time;
+
+    start_time = micros();
+    for (uint32_t i = 0; i < iterations; i++) {
+        node[0] = i;
+        nerd_sha256d_64(node, nerd_hash);
+    }
+    uint32_t time_nerd = micros() - start_time;
+
+    Serial.printf("mbedtls: %u nodes in %u µs\n", iterations, time_mbed);
+    Serial.printf("nerd_sha256d_64: %u nodes in %u µs\n", iterations, time_nerd);
+    Serial.printf("Speedup: %.2fx\n", (float)time_mbed / (float)time_nerd);
+    Serial.println();
+
+    // Last node hashed by both
+    TEST_ASSERT_EQUAL_MEMORY(mbed_hash, nerd_hash, 32);
+
+    Serial.println("Merkle node benchmark passed");
+}
+
 //=============================================================================
 // MEMORY PERFORMANCE BENCHMARKS
 //=============================================================================
@@ -550,6 +674,8 @@ void setup() {
     // SHA256 Performance Tests
     RUN_TEST(test_sha256_single_hash_benchmark);
     RUN_TEST(test_sha256_double_hash_benchmark);
+    RUN_TEST(test_nerd_sha256d_interleaved_benchmark);
+    RUN_TEST(test_merkle_node_benchmark);
 
     // Memory Performance Tests
     RUN_TEST(test_memory_allocation_benchmark);
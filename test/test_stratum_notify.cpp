@@ -0,0 +1,119 @@
+#include <unity.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "test_utils.h"
+#include "fixtures/stratum_test_vectors.h"
+
+// Only compile this for native tests
+#ifdef NATIVE_TEST
+
+#include <string>
+#include "../src/stratum_job.h"
+#include "../src/job_ring.h"
+
+//=============================================================================
+// STRATUM NOTIFY DECODER TESTS
+//=============================================================================
+
+// Test every field of a notify decodes to the bytes the header takes
+void test_stratum_notify_decode_fields(void) {
+    static mining_job job;
+    const test_stratum_mining_job* expected = &TEST_JOB_COMPLEX;
+    uint8_t bytes[STRATUM_COINB2_MAX];
+
+    TEST_ASSERT_TRUE(stratum_notify_decode(STRATUM_NOTIFY_COMPLEX, strlen(STRATUM_NOTIFY_COMPLEX), job));
+
+    TEST_ASSERT_EQUAL_STRING(expected->job_id, job.job_id);
+
+    // prevhash words byte swapped
+    hex_string_to_bytes(expected->prev_block_hash, bytes, 32);
+    for (int i = 0; i < 32; i++)
+        TEST_ASSERT_EQUAL_HEX8(bytes[(i & ~3) + 3 - (i & 3)], job.prev_block_hash[i]);
+
+    TEST_ASSERT_EQUAL_UINT32(strlen(expected->coinb1) / 2, job.coinb1_size);
+    hex_string_to_bytes(expected->coinb1, bytes, job.coinb1_size);
+    TEST_ASSERT_EQUAL_MEMORY(bytes, job.coinb1, job.coinb1_size);
+    TEST_ASSERT_EQUAL_UINT32(strlen(expected->coinb2) / 2, job.coinb2_size);
+    hex_string_to_bytes(expected->coinb2, bytes, job.coinb2_size);
+    TEST_ASSERT_EQUAL_MEMORY(bytes, job.coinb2, job.coinb2_size);
+
+    TEST_ASSERT_EQUAL_UINT32(expected->merkle_branch_count, job.merkle_count);
+    for (int k = 0; k < expected->merkle_branch_count; k++) {
+        hex_string_to_bytes(expected->merkle_branches[k], bytes, 32);
+        TEST_ASSERT_EQUAL_MEMORY(bytes, job.merkle_branch[k], 32);
+    }
+
+    TEST_ASSERT_EQUAL_HEX32(0x01000000, job.version);
+    TEST_ASSERT_EQUAL_HEX32(expected->target, job.nbits);
+    TEST_ASSERT_EQUAL_HEX32(0x495fab29, job.ntime);
+    TEST_ASSERT_EQUAL(expected->clean_jobs, job.clean_jobs);
+}
+
+// Test key order, whitespace, no branches and extra params don't matter
+void test_stratum_notify_decode_layout(void) {
+    static mining_job job;
+    const char* line =
+        "{ \"params\" : [ \"1f\", \"" "00000000000000000000000000000000000000000000000000000000deadbeef" "\","
+        " \"01\", \"\", [ ], \"20000000\", \"17034219\", \"65a1b2c3\", true, \"extra\", [1, {\"a\": \"]\"}] ],"
+        " \"id\" : null, \"method\" : \"mining.notify\" }";
+
+    TEST_ASSERT_TRUE(stratum_notify_decode(line, strlen(line), job));
+    TEST_ASSERT_EQUAL_STRING("1f", job.job_id);
+    TEST_ASSERT_EQUAL_HEX8(0xef, job.prev_block_hash[28]);
+    TEST_ASSERT_EQUAL_HEX8(0xde, job.prev_block_hash[31]);
+    TEST_ASSERT_EQUAL_UINT32(1, job.coinb1_size);
+    TEST_ASSERT_EQUAL_UINT32(0, job.coinb2_size);
+    TEST_ASSERT_EQUAL_UINT32(0, job.merkle_count);
+    TEST_ASSERT_EQUAL_HEX32(0x20000000, job.version);
+    TEST_ASSERT_EQUAL_HEX32(0x17034219, job.nbits);
+    TEST_ASSERT_EQUAL_HEX32(0x65a1b2c3, job.ntime);
+    TEST_ASSERT_TRUE(job.clean_jobs);
+}
+
+// Test other methods, bad hex and jobs that don't fit are refused
+void test_stratum_notify_decode_rejects(void) {
+    static mining_job job;
+    const char* lines[] = {
+        STRATUM_NOTIFY_MESSAGE,              // placeholder fields, not hex
+        STRATUM_SET_DIFFICULTY_MESSAGE,
+        STRATUM_SUBMIT_RESPONSE_ACCEPTED,
+        "{\"method\":\"mining.notify\"}",
+    };
+
+    for (size_t i = 0; i < sizeof(lines) / sizeof(lines[0]); i++)
+        TEST_ASSERT_FALSE(stratum_notify_decode(lines[i], strlen(lines[i]), job));
+
+    // Cut anywhere, the message never decodes
+    size_t len = strlen(STRATUM_NOTIFY_COMPLEX);
+    for (size_t cut = 0; cut < len; cut += 7)
+        TEST_ASSERT_FALSE(stratum_notify_decode(STRATUM_NOTIFY_COMPLEX, cut, job));
+
+    // One merkle branch more than a job holds
+    std::string line = "{\"method\":\"mining.notify\",\"params\":[\"1\",\"";
+    line += std::string(64, '0') + "\",\"00\",\"00\",[";
+    for (int k = 0; k <= MAX_MERKLE_BRANCHES; k++)
+        line += std::string(k ? "," : "") + "\"" + std::string(64, 'a') + "\"";
+    line += "],\"20000000\",\"1d00ffff\",\"495fab29\",false]}";
+    TEST_ASSERT_FALSE(stratum_notify_decode(line.c_str(), line.size(), job));
+}
+
+// Test a decoded job is owned, it survives a queue and the decode of the next message
+void test_stratum_notify_job_queue(void) {
+    static mining_job job;
+    static mining_job queued;
+    static JobRing<mining_job, 2> ring;
+
+    TEST_ASSERT_TRUE(stratum_notify_decode(STRATUM_NOTIFY_COMPLEX, strlen(STRATUM_NOTIFY_COMPLEX), job));
+    TEST_ASSERT_TRUE(ring.push(job));
+    memset(&job, 0xA5, sizeof(job));
+    TEST_ASSERT_FALSE(stratum_notify_decode(STRATUM_SET_DIFFICULTY_MESSAGE, strlen(STRATUM_SET_DIFFICULTY_MESSAGE), job));
+
+    TEST_ASSERT_TRUE(ring.pop(queued));
+    TEST_ASSERT_EQUAL_STRING(TEST_JOB_COMPLEX.job_id, queued.job_id);
+    TEST_ASSERT_EQUAL_UINT32(3, queued.merkle_count);
+    TEST_ASSERT_EQUAL_HEX8(0x98, queued.merkle_branch[0][0]);
+    TEST_ASSERT_EQUAL_HEX32(0x1d00ffff, queued.nbits);
+}
+
+#endif // NATIVE_TEST
@@ -0,0 +1,71 @@
+#include <unity.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "test_utils.h"
+
+// Only compile this for native tests
+#ifdef NATIVE_TEST
+
+#include <string>
+#include "../src/stratum_submit.h"
+
+//=============================================================================
+// STRATUM SUBMIT TEMPLATE TESTS
+//=============================================================================
+
+// Test a patched template is the message the pool takes, for any id width
+void test_stratum_submit_encode(void) {
+    static stratum_submit submit;
+    char expected[STRATUM_SUBMIT_MAX];
+    const uint32_t ids[] = { 3, 42, 1000000, 0xFFFFFFFF };
+    size_t len;
+
+    TEST_ASSERT_TRUE(stratum_submit_init(submit, "test_user.worker1", "job_id_001", 4, true));
+    for (size_t i = 0; i < sizeof(ids) / sizeof(ids[0]); i++) {
+        const char* msg = stratum_submit_encode(submit, ids[i], 0x1234abcd, 0x495fab29, 0x00c0ffee, 0x00006000, len);
+        snprintf(expected, sizeof(expected),
+            "{\"id\":%u,\"method\":\"mining.submit\",\"params\":[\"test_user.worker1\",\"job_id_001\","
+            "\"1234abcd\",\"495fab29\",\"00c0ffee\",\"00006000\"]}\n", ids[i]);
+        TEST_ASSERT_EQUAL_UINT32(strlen(expected), len);
+        TEST_ASSERT_EQUAL_STRING(expected, std::string(msg, len).c_str());
+    }
+}
+
+// Test extranonce2 takes its size in big endian hex and no version without rolling
+void test_stratum_submit_layout(void) {
+    static stratum_submit submit;
+    size_t len;
+
+    TEST_ASSERT_TRUE(stratum_submit_init(submit, "w", "1f", 8, false));
+    const char* msg = stratum_submit_encode(submit, 7, 0x0102030405060708ull, 1, 0xFFFFFFFF, 0x1FFFE000, len);
+    TEST_ASSERT_EQUAL_STRING(
+        "{\"id\":7,\"method\":\"mining.submit\",\"params\":[\"w\",\"1f\",\"0102030405060708\",\"00000001\",\"ffffffff\"]}\n",
+        std::string(msg, len).c_str());
+
+    // A smaller extranonce2 keeps its low bytes, a later share overwrites every digit
+    TEST_ASSERT_TRUE(stratum_submit_init(submit, "w", "1f", 2, false));
+    stratum_submit_encode(submit, 123456, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0, len);
+    msg = stratum_submit_encode(submit, 8, 0xAB01, 0, 0, 0, len);
+    TEST_ASSERT_EQUAL_STRING(
+        "{\"id\":8,\"method\":\"mining.submit\",\"params\":[\"w\",\"1f\",\"ab01\",\"00000000\",\"00000000\"]}\n",
+        std::string(msg, len).c_str());
+}
+
+// Test templates that can't be built are refused and left empty
+void test_stratum_submit_rejects(void) {
+    static stratum_submit submit;
+    std::string worker(STRATUM_SUBMIT_MAX, 'w');
+
+    TEST_ASSERT_FALSE(stratum_submit_init(submit, "w", "1f", 0, true));
+    TEST_ASSERT_EQUAL_UINT32(0, submit.len);
+    TEST_ASSERT_FALSE(stratum_submit_init(submit, "w", "1f", STRATUM_EXTRANONCE2_MAX + 1, true));
+    TEST_ASSERT_FALSE(stratum_submit_init(submit, worker.c_str(), "1f", 4, true));
+    TEST_ASSERT_EQUAL_UINT32(0, submit.len);
+
+    // Longest worker name and job id the firmware holds still fit
+    TEST_ASSERT_TRUE(stratum_submit_init(submit, std::string(STRATUM_WORKER_MAX, 'w').c_str(), std::string(STRATUM_JOB_ID_MAX, 'j').c_str(),
+                                         STRATUM_EXTRANONCE2_MAX, true));
+}
+
+#endif // NATIVE_TEST
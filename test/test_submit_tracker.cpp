@@ -0,0 +1,91 @@
+#include <unity.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "test_utils.h"
+
+// Only compile this for native tests
+#ifdef NATIVE_TEST
+
+#include "../src/submit_tracker.h"
+
+static Submition test_submition(uint32_t id, uint32_t sent_us) {
+    Submition s;
+    s.id = id;
+    s.sent_us = sent_us;
+    s.diff = id;
+    s.is32bit = false;
+    s.isValid = false;
+    return s;
+}
+
+//=============================================================================
+// SUBMIT TRACKER TESTS
+//=============================================================================
+
+// Test answers match their share by id, in any order, and only once
+void test_submit_tracker_answers(void) {
+    static SubmitStats stats;
+    static SubmitTracker tracker(stats);
+    Submition found;
+
+    tracker.sent(test_submition(10, 1000));
+    tracker.sent(test_submition(11, 2000));
+    tracker.sent(test_submition(12, 3000));
+    TEST_ASSERT_EQUAL_UINT32(3, tracker.size());
+
+    TEST_ASSERT_TRUE(tracker.answered(12, 33000, SUBMIT_ACCEPTED, found));
+    TEST_ASSERT_EQUAL_UINT32(12, found.id);
+    TEST_ASSERT_EQUAL_UINT32(30000, stats.rtt_last_us.load());
+    TEST_ASSERT_TRUE(tracker.answered(10, 501000, SUBMIT_STALE, found));
+    TEST_ASSERT_EQUAL_UINT32(10, found.id);
+    TEST_ASSERT_FALSE(tracker.answered(10, 502000, SUBMIT_ACCEPTED, found));
+    TEST_ASSERT_FALSE(tracker.answered(99, 502000, SUBMIT_ACCEPTED, found));
+    TEST_ASSERT_TRUE(tracker.answered(11, 5002000, SUBMIT_REJECTED, found));
+
+    TEST_ASSERT_EQUAL_UINT32(3, stats.sent.load());
+    TEST_ASSERT_EQUAL_UINT32(1, stats.accepted.load());
+    TEST_ASSERT_EQUAL_UINT32(1, stats.rejected.load());
+    TEST_ASSERT_EQUAL_UINT32(1, stats.stale.load());
+    TEST_ASSERT_EQUAL_UINT32(5000000, stats.rtt_max_us.load());
+    TEST_ASSERT_EQUAL_UINT32(0, tracker.size());
+
+    // 30ms, 500ms and 5s land in their buckets
+    TEST_ASSERT_EQUAL_UINT32(1, stats.rtt[1].load());
+    TEST_ASSERT_EQUAL_UINT32(1, stats.rtt[5].load());
+    TEST_ASSERT_EQUAL_UINT32(1, stats.rtt[SUBMIT_RTT_BUCKETS - 1].load());
+}
+
+// Test unanswered shares are counted lost when evicted or dropped with the connection
+void test_submit_tracker_lost(void) {
+    static SubmitStats stats;
+    static SubmitTracker tracker(stats);
+    Submition found;
+
+    for (uint32_t id = 1; id <= SUBMIT_PENDING_MAX + 2; id++)
+        tracker.sent(test_submition(id, 0));
+    TEST_ASSERT_EQUAL_UINT32(2, stats.lost.load());
+    TEST_ASSERT_EQUAL_UINT32(SUBMIT_PENDING_MAX, tracker.size());
+
+    // The oldest ones went, the newest are still matched
+    TEST_ASSERT_FALSE(tracker.answered(1, 1000, SUBMIT_ACCEPTED, found));
+    TEST_ASSERT_FALSE(tracker.answered(2, 1000, SUBMIT_ACCEPTED, found));
+    TEST_ASSERT_TRUE(tracker.answered(3, 1000, SUBMIT_ACCEPTED, found));
+    TEST_ASSERT_TRUE(tracker.answered(SUBMIT_PENDING_MAX + 2, 1000, SUBMIT_ACCEPTED, found));
+
+    tracker.clear();
+    TEST_ASSERT_EQUAL_UINT32(0, tracker.size());
+    TEST_ASSERT_EQUAL_UINT32(SUBMIT_PENDING_MAX, stats.lost.load());   // 2 evicted, the 30 still pending
+    TEST_ASSERT_EQUAL_UINT32(2, stats.rtt[0].load());
+
+    // Round trips on the bucket limits and across the micros() wrap
+    TEST_ASSERT_EQUAL_UINT32(0, SubmitTracker::rttBucket(0));
+    TEST_ASSERT_EQUAL_UINT32(0, SubmitTracker::rttBucket(24999));
+    TEST_ASSERT_EQUAL_UINT32(1, SubmitTracker::rttBucket(25000));
+    TEST_ASSERT_EQUAL_UINT32(SUBMIT_RTT_BUCKETS - 1, SubmitTracker::rttBucket(0xFFFFFFFF));
+    tracker.sent(test_submition(7, 0xFFFFF000));
+    TEST_ASSERT_TRUE(tracker.answered(7, 0x1000, SUBMIT_ACCEPTED, found));
+    TEST_ASSERT_EQUAL_UINT32(0x2000, stats.rtt_last_us.load());
+}
+
+#endif // NATIVE_TEST
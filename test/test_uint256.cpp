@@ -0,0 +1,115 @@
+#include <unity.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "test_utils.h"
+
+// Only compile this for native tests
+#ifdef NATIVE_TEST
+
+#include "../src/uint256.h"
+
+static const double TEST_TRUEDIFFONE = 26959535291011309493156476344723991336010898738574164086137773096960.0;
+
+// Same conversion as le256todouble() in utils.cpp
+static double test_le256todouble(const uint8_t* value) {
+    double result = 0;
+    for (int i = 31; i >= 0; i--)
+        result = result * 256.0 + value[i];
+    return result;
+}
+
+//=============================================================================
+// UINT256 TARGET TESTS
+//=============================================================================
+
+// Test difficulty 1 and nbits 0x1d00ffff give the same target
+void test_uint256_diff1_target(void) {
+    uint256 from_diff;
+    uint256 from_nbits;
+
+    uint256_from_diff(1.0, &from_diff);
+    uint256_from_nbits(0x1d00ffff, &from_nbits);
+
+    for (int i = 0; i < 8; i++) {
+        TEST_ASSERT_EQUAL_HEX32(i == 6 ? 0xFFFF0000 : 0, from_diff.word[i]);
+        TEST_ASSERT_EQUAL_HEX32(from_diff.word[i], from_nbits.word[i]);
+    }
+}
+
+// Test compact targets with a small exponent and a mainnet one
+void test_uint256_from_nbits(void) {
+    uint256 target;
+
+    uint256_from_nbits(0x17034219, &target);
+    for (int i = 0; i < 8; i++)
+        TEST_ASSERT_EQUAL_HEX32(i == 5 ? 0x00034219 : 0, target.word[i]);
+
+    uint256_from_nbits(0x02123456, &target);
+    TEST_ASSERT_EQUAL_HEX32(0x1234, target.word[0]);
+    for (int i = 1; i < 8; i++)
+        TEST_ASSERT_EQUAL_HEX32(0, target.word[i]);
+}
+
+// Test the compare around the target value
+void test_uint256_hash_below_edges(void) {
+    uint256 target;
+    uint8_t hash[32];
+
+    uint256_from_nbits(0x1d00ffff, &target);
+
+    memcpy(hash, target.word, 32);
+    TEST_ASSERT_FALSE(uint256_hash_below(hash, &target));
+
+    // target - 1
+    memset(hash, 0xFF, 26);
+    hash[26] = 0xFE;
+    hash[27] = 0xFF;
+    memset(hash + 28, 0, 4);
+    TEST_ASSERT_TRUE(uint256_hash_below(hash, &target));
+
+    // target + 1, only the least significant byte differs
+    memcpy(hash, target.word, 32);
+    hash[0] = 1;
+    TEST_ASSERT_FALSE(uint256_hash_below(hash, &target));
+
+    memset(hash, 0, 32);
+    TEST_ASSERT_TRUE(uint256_hash_below(hash, &target));
+    memset(hash, 0xFF, 32);
+    TEST_ASSERT_FALSE(uint256_hash_below(hash, &target));
+
+    // Tiny difficulty saturates instead of overflowing
+    uint256_from_diff(1e-12, &target);
+    for (int i = 0; i < 8; i++)
+        TEST_ASSERT_EQUAL_HEX32(0xFFFFFFFF, target.word[i]);
+}
+
+// Test the integer compare agrees with the float difficulty the pool sees
+void test_uint256_matches_float_difficulty(void) {
+    const double difficulties[] = { 0.00015, 0.5, 1.0, 512.0, 65536.0, 1e6 };
+    uint32_t seed = 0x12345678;
+
+    for (size_t d = 0; d < sizeof(difficulties) / sizeof(difficulties[0]); d++) {
+        uint256 target;
+        uint256_from_diff(difficulties[d], &target);
+
+        for (int n = 0; n < 2000; n++) {
+            uint8_t hash[32];
+            for (int i = 0; i < 32; i++) {
+                seed = seed * 1664525 + 1013904223;
+                hash[i] = seed >> 24;
+            }
+            // Clear the top bytes so hashes land on both sides of the target
+            int zero_bytes = 2 + (n % 6);
+            memset(hash + 32 - zero_bytes, 0, zero_bytes);
+
+            double diff_hash = TEST_TRUEDIFFONE / test_le256todouble(hash);
+            // Skip hashes within double rounding of the target
+            if (diff_hash > difficulties[d] * 0.999999 && diff_hash < difficulties[d] * 1.000001)
+                continue;
+            TEST_ASSERT_EQUAL(diff_hash > difficulties[d], uint256_hash_below(hash, &target));
+        }
+    }
+}
+
+#endif // NATIVE_TEST